@@ -0,0 +1,152 @@
+#!/bin/bash
+# -- vw allreduce test
+#
+# Trains several vw nodes over loopback through a local spanning tree
+# server and checks that every node ends with the same model.  With
+# --loss_tolerance X it trains again summing fp32 and checks that the
+# average losses differ by at most X relative to that run, and with
+# --label_scale K the labels are multiplied by K.  Other arguments go to
+# every node.
+#
+NAME='allreduce-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+SPANNING_TREE=../cluster/spanning_tree
+
+TRAINSET=train-sets/0001.dat
+PIDFILE=$NAME.pid
+Total=3
+Hosts=0
+LossTolerance=
+LabelScale=1
+VwArgs=
+EncodingArgs=
+
+while [ $# -gt 0 ]
+do
+    case "$1" in
+        --total)
+            Total="$2"
+            shift
+            ;;
+        --hosts)
+            # pretend node i runs on host i % Hosts
+            Hosts="$2"
+            shift
+            ;;
+        --loss_tolerance)
+            LossTolerance="$2"
+            shift
+            ;;
+        --label_scale)
+            LabelScale="$2"
+            shift
+            ;;
+        --allreduce_encoding)
+            # left out of the fp32 run --loss_tolerance compares against
+            EncodingArgs="$EncodingArgs $1 $2"
+            shift
+            ;;
+        --allreduce_error_feedback)
+            EncodingArgs="$EncodingArgs $1"
+            ;;
+        *)
+            # everything else goes to every node
+            VwArgs="$VwArgs $1"
+            ;;
+    esac
+    shift
+done
+
+# -- make sure we can find vw and the spanning tree server first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+if [ -x "$SPANNING_TREE" ]; then
+    : cool found spanning_tree at: $SPANNING_TREE
+else
+    echo "$NAME: can not find $SPANNING_TREE - run 'make spanning_tree' first"
+    exit 1
+fi
+
+cleanup() {
+    if [ -f $PIDFILE ]; then
+        kill `cat $PIDFILE` 2>/dev/null
+        rm -f $PIDFILE
+    fi
+    for ((i = 0; i < Total; i++)); do
+        rm -f $NAME.$i.dat $NAME.$i.cache $NAME.$i.model $NAME.$i.stderr $NAME.$i.fp32.stderr
+    done
+}
+
+cleanup
+$SPANNING_TREE $PIDFILE > /dev/null 2>&1
+# wait for the server to write its pid once it has daemonized
+until [ -s $PIDFILE ]; do sleep 0.1; done
+
+# every node learns on its own lines of the training set
+for ((i = 0; i < Total; i++)); do
+    awk -v n=$Total -v i=$i -v k=$LabelScale 'NR % n == i { $1 = $1 * k; print }' $TRAINSET > $NAME.$i.dat
+done
+
+# train_nodes UNIQUE_ID STDERR_SUFFIX ARGS...: trains every node, failing if any does
+train_nodes() {
+    local Id=$1 Suffix=$2
+    shift 2
+    local Pids= Failed=false i Pid
+    for ((i = 0; i < Total; i++)); do
+        HostArgs=
+        if [ $Hosts -gt 0 ]; then
+            HostArgs="--allreduce_host host$((i % Hosts))"
+        fi
+        $VW --span_server localhost --total $Total --node $i --unique_id $Id \
+            -d $NAME.$i.dat -k --cache_file $NAME.$i.cache --passes 3 --holdout_off -b 18 \
+            -f $NAME.$i.model "$@" $HostArgs > $NAME.$i$Suffix.stderr 2>&1 &
+        Pids="$Pids $!"
+    done
+    for Pid in $Pids; do
+        wait $Pid || Failed=true
+    done
+    if $Failed; then
+        echo "$NAME FAILED: a node exited with an error, see $NAME.*.stderr"
+        kill `cat $PIDFILE` 2>/dev/null
+        exit 1
+    fi
+}
+
+average_loss() {
+    sed -n 's/^average loss = \([^ ]*\).*/\1/p' $1
+}
+
+if [ -n "$LossTolerance" ]; then
+    train_nodes $(($$ + 1)) .fp32 $VwArgs
+fi
+train_nodes $$ "" $VwArgs $EncodingArgs
+
+for ((i = 1; i < Total; i++)); do
+    if ! cmp -s $NAME.0.model $NAME.$i.model; then
+        echo "$NAME FAILED: the models of nodes 0 and $i differ"
+        kill `cat $PIDFILE` 2>/dev/null
+        exit 1
+    fi
+done
+
+if [ -n "$LossTolerance" ]; then
+    Loss=`average_loss $NAME.0.stderr`
+    Fp32Loss=`average_loss $NAME.0.fp32.stderr`
+    if ! awk -v l=$Loss -v f=$Fp32Loss -v t=$LossTolerance \
+        'BEGIN { d = l - f; if (d < 0) d = -d; if (f < 0) f = -f; exit !(d <= t * f) }'; then
+        echo "$NAME FAILED: average loss $Loss against $Fp32Loss summing fp32"
+        kill `cat $PIDFILE` 2>/dev/null
+        exit 1
+    fi
+fi
+
+echo "$NAME: OK"
+cleanup
+exit 0
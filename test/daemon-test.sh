@@ -11,6 +11,7 @@ MODEL=$NAME.model
 TRAINSET=$NAME.train
 PREDREF=$NAME.predref
 PREDOUT=$NAME.predict
+REQUESTS=$NAME.requests
 PORT=54248
 
 while [ $# -gt 0 ]
@@ -19,6 +20,14 @@ do
         --foreground)
             Foreground="$1"
             ;;
+        --reload)
+            # have the daemon reload its model between the two examples
+            Reload="$1"
+            ;;
+        --io_threads|--io_batch_size|--io_batch_wait|--snapshot_every)
+            IoArgs="$IoArgs $1 $2"
+            shift
+            ;;
         *)
             echo "$NAME: unknown argument $1"
             exit 1
@@ -60,7 +69,7 @@ fi
 
 
 # A command (+pattern) that is unlikely to match anything but our own test
-DaemonCmd="$VW -t -i $MODEL --daemon $Foreground --num_children 1 --quiet --port $PORT"
+DaemonCmd="$VW -t -i $MODEL --daemon $Foreground --num_children 1 $IoArgs --quiet --port $PORT"
 # libtool may wrap vw with '.libs/lt-vw' so we need to be flexible
 # on the exact process pattern we try to kill.
 DaemonPat=`echo $DaemonCmd | sed 's/^[^ ]*vw /.*vw /'`
@@ -92,7 +101,7 @@ start_daemon() {
 }
 
 cleanup() {
-    /bin/rm -f $MODEL $TRAINSET $PREDREF $PREDOUT
+    /bin/rm -f $MODEL $TRAINSET $PREDREF $PREDOUT $REQUESTS
     stop_daemon
 }
 
@@ -114,6 +123,12 @@ EOF
 # Train
 $VW -b 10 --quiet -d $TRAINSET -f $MODEL
 
+if [ $Reload ]; then
+    sed "1a 'load_$MODEL" $TRAINSET > $REQUESTS
+else
+    cp $TRAINSET $REQUESTS
+fi
+
 DaemonPid=`start_daemon`
 
 # Test --foreground argument
@@ -145,7 +160,7 @@ fi
 #wait
 # However, GNU netcat does not know -q, so let's do a work-around
 touch $PREDOUT
-$NETCAT localhost $PORT < $TRAINSET > $PREDOUT &
+$NETCAT localhost $PORT < $REQUESTS > $PREDOUT &
 # Wait until we recieve a prediction from the vw daemon then kill netcat
 until [ `wc -l < $PREDOUT` -eq 2 ]; do :; done
 $PKILL -9 $NETCAT
@@ -0,0 +1,77 @@
+#!/bin/bash
+# -- vw learner threads test
+#
+# Trains on 0002.dat once on one thread and once with --learner_threads N,
+# and checks that the average losses differ by at most --tolerance X
+# relative to the single threaded run.  The threads update the weights
+# without locks, so the runs need not match exactly.  Other arguments go
+# to both runs.
+#
+NAME='learner-threads-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+TRAINSET=train-sets/0002.dat
+Threads=4
+Tolerance=0.05
+VwArgs=
+
+while [ $# -gt 0 ]
+do
+    case "$1" in
+        --threads)
+            Threads="$2"
+            shift
+            ;;
+        --tolerance)
+            Tolerance="$2"
+            shift
+            ;;
+        *)
+            VwArgs="$VwArgs $1"
+            ;;
+    esac
+    shift
+done
+
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    rm -f $NAME.cache $NAME.stderr $NAME.threads.stderr
+}
+
+average_loss() {
+    sed -n 's/^average loss = \([^ ]*\).*/\1/p' $1
+}
+
+cleanup
+$VW -d $TRAINSET -k --cache_file $NAME.cache $VwArgs > $NAME.stderr 2>&1
+$VW -d $TRAINSET -k --cache_file $NAME.cache --learner_threads $Threads $VwArgs > $NAME.threads.stderr 2>&1
+
+if ! grep -q "^learning on $Threads threads" $NAME.threads.stderr; then
+    echo "$NAME FAILED: vw did not learn on $Threads threads, see $NAME.threads.stderr"
+    exit 1
+fi
+
+Loss=`average_loss $NAME.stderr`
+ThreadsLoss=`average_loss $NAME.threads.stderr`
+if [ -z "$Loss" -o -z "$ThreadsLoss" ]; then
+    echo "$NAME FAILED: training failed, see $NAME.stderr and $NAME.threads.stderr"
+    exit 1
+fi
+if ! awk -v l=$Loss -v t=$ThreadsLoss -v x=$Tolerance \
+    'BEGIN { d = t - l; if (d < 0) d = -d; exit !(d <= x * l) }'; then
+    echo "$NAME FAILED: average loss $ThreadsLoss on $Threads threads against $Loss on one"
+    exit 1
+fi
+
+echo "$NAME: OK"
+cleanup
+exit 0
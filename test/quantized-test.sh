@@ -0,0 +1,73 @@
+#!/bin/bash
+# -- vw quantized model test
+#
+# Trains on 0002.dat, writing a float model and a quantized one, and
+# checks that their predictions stay within --tolerance of each other.
+# Prints that the model was refused when vw will not quantize it.
+# Arguments other than --tolerance X go to the training run.
+#
+NAME='quantized-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+TRAINSET=train-sets/0002.dat
+Tolerance=0.01
+VwArgs=
+
+while [ $# -gt 0 ]
+do
+    case "$1" in
+        --tolerance)
+            Tolerance="$2"
+            shift
+            ;;
+        *)
+            VwArgs="$VwArgs $1"
+            ;;
+    esac
+    shift
+done
+
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    rm -f $NAME.model $NAME.quantized $NAME.stderr $NAME.predict $NAME.quantized.predict
+}
+
+cleanup
+# vw exits 0 even when it refuses its arguments, so look at what it wrote
+$VW -d $TRAINSET -f $NAME.model --quantized_regressor $NAME.quantized $VwArgs > $NAME.stderr 2>&1
+if grep -q "a quantized model can not be used with" $NAME.stderr; then
+    echo "$NAME: refused"
+    cleanup
+    exit 0
+fi
+if [ ! -s $NAME.model -o ! -s $NAME.quantized ]; then
+    echo "$NAME FAILED: training failed, see $NAME.stderr"
+    exit 1
+fi
+
+$VW -t -i $NAME.model -d $TRAINSET -p $NAME.predict --quiet || exit 1
+$VW -t -i $NAME.quantized -d $TRAINSET -p $NAME.quantized.predict --quiet || exit 1
+if [ ! -s $NAME.predict -o ! -s $NAME.quantized.predict ]; then
+    echo "$NAME FAILED: no predictions"
+    exit 1
+fi
+
+# the largest difference between the predictions of the two models
+Worst=`paste -d ' ' <(cut -d ' ' -f 1 $NAME.predict) <(cut -d ' ' -f 1 $NAME.quantized.predict) | \
+    awk '{ d = $1 - $2; if (d < 0) d = -d; if (d > worst) worst = d } END { print worst + 0 }'`
+if awk -v w=$Worst -v t=$Tolerance 'BEGIN { exit !(w <= t) }'; then
+    echo "$NAME: OK"
+    cleanup
+    exit 0
+fi
+echo "$NAME FAILED: predictions differ by up to $Worst"
+exit 1
@@ -12,29 +12,151 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <sys/timeb.h>
 #include <cmath>
 #include <stdint.h>
+#include <thread>
+#include <chrono>
+#include <exception>
 #include "global_data.h"
 #include "vw_allreduce.h"
+#include "rand48.h"
 
 using namespace std;
 
 void add_float(float& c1, const float& c2) { c1 += c2; }
 
+void add_count(uint64_t& c1, const uint64_t& c2) { c1 += c2; }
+
+// Sums over the nodes the entries of v which differ from base, or which are nonzero when there is
+// no base, exchanging only those entries.  Returns false instead, leaving the nodes to sum v
+// densely, when between them they changed more than --sparse_allreduce of its entries; every node
+// sees the same count and so decides the same way.
+bool sum_changes(vw& all, const float* v, const float* base, uint64_t length, vector<sparse_entry>& changes)
+{ if (all.sparse_allreduce <= 0.f || all.all_reduce_type != AllReduceType::Socket)
+    return false;
+
+  uint64_t changed = 0;
+  for (uint64_t i = 0; i < length; i++)
+    if ((base == nullptr ? v[i] : v[i] - base[i]) != 0.f)
+      changed++;
+  // the sum counts an entry once per node which changed it, so bounds the merged list
+  all_reduce<uint64_t, add_count>(all, &changed, 1);
+  if (changed > all.sparse_allreduce * length)
+    return false;
+
+  changes.clear();
+  for (uint64_t i = 0; i < length; i++)
+  { float change = base == nullptr ? v[i] : v[i] - base[i];
+    if (change != 0.f)
+    { sparse_entry e = { (uint32_t)i, change };
+      changes.push_back(e);
+    }
+  }
+  ((AllReduceSockets*)all.all_reduce)->sparse_all_reduce(changes);
+  return true;
+}
+
+void add_half(uint16_t& h1, const uint16_t& h2) { h1 = float_to_half(half_to_float(h1) + half_to_float(h2)); }
+
+void add_int8(int8_t& c1, const int8_t& c2) { c1 += c2; }
+
+void max_float(float& c1, const float& c2) { c1 = max(c1, c2); }
+
+const uint32_t encoding_chunk_shift = 8; // encodings share one scale per 256 entries
+
+// Sums v over the nodes encoded as --allreduce_encoding says, fp16 or int8, at a scale per chunk
+// which the nodes agree on first from the largest |v| any of them holds there.  fp16 scales each
+// chunk by a power of two so that the sum over the nodes lies just below 2^15, well inside the
+// range of a half whatever the magnitude of v.  A node sends int8 codes of at most 127 / total so
+// that adding them cannot overflow, rounding stochastically so that the sum is unbiased.  With
+// --allreduce_error_feedback, what the encoding dropped from this node's v is added into its next
+// exchange at the same offset.
+void sum_encoded(vw& all, float* v, uint64_t length, size_t offset, uint64_t& random_state)
+{ if (all.allreduce_encoding == QUANTIZE_NONE)
+  { all_reduce<float, add_float>(all, v, length); //TODO: modify to not use first()
+    return;
+  }
+  if (all.allreduce_encoding == QUANTIZE_INT8 && all.all_reduce->total > 127)
+    THROW("--allreduce_encoding int8 sums over at most 127 nodes, not " << all.all_reduce->total);
+
+  float* residual = nullptr;
+  if (all.allreduce_error_feedback)
+  { float*& r = all.allreduce_residuals[offset];
+    if (r == nullptr)
+      r = calloc_or_throw<float>(length);
+    residual = r;
+    for (uint64_t i = 0; i < length; i++)
+      v[i] += residual[i];
+  }
+
+  uint64_t chunks = ((length - 1) >> encoding_chunk_shift) + 1;
+  float* steps = new float[chunks]();
+  for (uint64_t i = 0; i < length; i++)
+    steps[i >> encoding_chunk_shift] = max(steps[i >> encoding_chunk_shift], fabsf(v[i]));
+  all_reduce<float, max_float>(all, steps, chunks);
+
+  if (all.allreduce_encoding == QUANTIZE_FP16)
+  { for (uint64_t c = 0; c < chunks; c++)
+    { int exponent;
+      frexpf(steps[c] * all.all_reduce->total, &exponent);
+      steps[c] = ldexpf(1.f, exponent - 15);
+    }
+    uint16_t* halves = new uint16_t[length];
+    for (uint64_t i = 0; i < length; i++)
+    { float step = steps[i >> encoding_chunk_shift];
+      halves[i] = float_to_half(v[i] / step);
+      if (residual != nullptr)
+        residual[i] = v[i] - half_to_float(halves[i]) * step;
+    }
+    all_reduce<uint16_t, add_half>(all, halves, length);
+    for (uint64_t i = 0; i < length; i++)
+      v[i] = half_to_float(halves[i]) * steps[i >> encoding_chunk_shift];
+    delete[] halves;
+    delete[] steps;
+    return;
+  }
+
+  float levels = (float)(127 / all.all_reduce->total); // the largest code a node sends
+  for (uint64_t c = 0; c < chunks; c++)
+    steps[c] /= levels;
+
+  int8_t* codes = new int8_t[length];
+  for (uint64_t i = 0; i < length; i++)
+  { float step = steps[i >> encoding_chunk_shift];
+    float code = step == 0.f ? 0.f : floorf(v[i] / step + merand48(random_state));
+    code = min(levels, max(-levels, code));
+    codes[i] = (int8_t)code;
+    if (residual != nullptr)
+      residual[i] = v[i] - code * step;
+  }
+  all_reduce<int8_t, add_int8>(all, codes, length);
+  for (uint64_t i = 0; i < length; i++)
+    v[i] = codes[i] * steps[i >> encoding_chunk_shift];
+  delete[] codes;
+  delete[] steps;
+}
+
 void accumulate(vw& all, parameters& weights, size_t offset)
 { uint64_t length = 1 << all.num_bits; //This is size of gradient
   float* local_grad = new float[length];
 
   if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset];
+  { memset(local_grad, 0, length * sizeof(float));
+    weights.sparse_weights.gather(local_grad, offset, 1);
+  }
   else
     for (uint64_t i = 0; i < length; i++)
       local_grad[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset];    
   
-  all_reduce<float, add_float>(all, local_grad, length); //TODO: modify to not use first()
+  vector<sparse_entry> changes;
+  if (sum_changes(all, local_grad, nullptr, length, changes))
+  { memset(local_grad, 0, length * sizeof(float));
+    for (sparse_entry& e : changes)
+      local_grad[e.index] = e.value;
+  }
+  else
+    sum_encoded(all, local_grad, length, offset, all.random_state);
 
   if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset] = local_grad[i];
+    weights.sparse_weights.scatter(local_grad, offset, 1);
   else
     for (uint64_t i = 0; i < length; i++)
       (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset] = local_grad[i];
@@ -54,20 +176,39 @@ void accumulate_avg(vw& all, parameters& weights, size_t offset)
   float* local_grad = new float[length];
 
   if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset];
+  { memset(local_grad, 0, length * sizeof(float));
+    weights.sparse_weights.gather(local_grad, offset, 1);
+  }
   else
     for (uint64_t i = 0; i < length; i++)
       local_grad[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset];    
   
-  all_reduce<float, add_float>(all, local_grad, length); //TODO: modify to not use first()
+  // after the first average the nodes share the weights it left, so the average of their weights
+  // is those plus the average of what each changed since
+  vector<sparse_entry> changes;
+  float* base = all.allreduce_base;
+  if (base != nullptr && sum_changes(all, local_grad, base, length, changes))
+  { memcpy(local_grad, base, length * sizeof(float));
+    for (sparse_entry& e : changes)
+      local_grad[e.index] = base[e.index] + e.value / numnodes;
+  }
+  else
+  { sum_encoded(all, local_grad, length, offset, all.random_state);
+    for (uint64_t i = 0; i < length; i++)
+      local_grad[i] /= numnodes;
+  }
+
+  if (all.sparse_allreduce > 0.f)
+  { if (base == nullptr)
+      all.allreduce_base = base = calloc_or_throw<float>(length);
+    memcpy(base, local_grad, length * sizeof(float));
+  }
 
   if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset] = local_grad[i] / numnodes;
+    weights.sparse_weights.scatter(local_grad, offset, 1);
   else
     for (uint64_t i = 0; i < length; i++)
-      (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset] = local_grad[i] / numnodes;
+      (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset] = local_grad[i];
  
   delete[] local_grad;
 }
@@ -86,25 +227,20 @@ float min_elem(float* arr, int length)
   return min;
 }
 
-template<class T>
-void do_weighting(vw& all, uint64_t length, float* local_weights, T& weights)
-{
-  for (uint64_t i = 0; i < length; i++)
-    {
-      float* weight = &weights[i << weights.stride_shift()];
-      if (local_weights[i] > 0)
-	{ float ratio = weight[1] / local_weights[i];
-	  local_weights[i] = weight[0] * ratio;
-	  weight[0] *= ratio;
-	  weight[1] *= ratio; //A crude max
-	  if (all.normalized_updates)
-	    weight[all.normalized_idx] *= ratio; //A crude max
-	}
-      else
-	{  local_weights[i] = 0;
-	  *weight = 0;
-	}
-    }
+// Scales the stride w of a feature by its share of the summed adaptive sums, as a crude max.
+void do_weighting(vw& all, float& local_weight, float* w)
+{ if (local_weight > 0)
+  { float ratio = w[1] / local_weight;
+    local_weight = w[0] * ratio;
+    w[0] *= ratio;
+    w[1] *= ratio; //A crude max
+    if (all.normalized_updates)
+      w[all.normalized_idx] *= ratio; //A crude max
+  }
+  else
+  { local_weight = 0;
+    *w = 0;
+  }
 }
 
 void accumulate_weighted_avg(vw& all, parameters& weights)
@@ -116,24 +252,127 @@ void accumulate_weighted_avg(vw& all, parameters& weights)
   float* local_weights = new float[length];
 
   if (weights.sparse)
+  { // weigh a dense copy of the touched strides, which is what allreduce sums
+    sparse_parameters& sparse = weights.sparse_weights;
+    size_t stride = sparse.stride();
+    float* dense = new float[length * stride]();
+    sparse.gather(dense, 0, stride);
     for (uint64_t i = 0; i < length; i++)
-      local_weights[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[1];
+      local_weights[i] = dense[i * stride + 1];
+
+    //First compute weights for averaging
+    all_reduce<float, add_float>(all, local_weights, length);
+
+    for (uint64_t i = 0; i < length; i++)
+      do_weighting(all, local_weights[i], dense + i * stride);
+    all_reduce<float, add_float>(all, dense, length * stride);
+    sparse.scatter(dense, 0, stride);
+    delete[] dense;
+  }
   else
+  { for (uint64_t i = 0; i < length; i++)
+      local_weights[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[1];
+
+    //First compute weights for averaging
+    all_reduce<float, add_float>(all, local_weights, length);
+
     for (uint64_t i = 0; i < length; i++)
-      local_weights[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[1];    
+      do_weighting(all, local_weights[i], &weights.dense_weights[i << weights.dense_weights.stride_shift()]);
+    all_reduce<float, add_float>(all, weights.dense_weights.first(), length*weights.stride_shift());
+  }
+  delete[] local_weights;
+}
 
-  //First compute weights for averaging
-  all_reduce<float, add_float>(all, local_weights, length);
+struct async_avg
+{ vw* all;
+  float* snapshot; // the weights as they were when the average in flight started
+  float* sum;      // which the thread sums over the nodes
+  std::thread reducer;
+  bool in_flight;
+  std::exception_ptr failure;
+  uint64_t random_state; // of int8 encodings, apart from the one learning draws from
+  double reduce_seconds; // spent summing
+  double wait_seconds;   // of which learning waited for
+};
 
-  if (weights.sparse)
-    do_weighting(all, length, local_weights, weights.sparse_weights);
+double seconds_since(chrono::steady_clock::time_point begin)
+{ return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+void get_weights(parameters& weights, float* into, uint64_t length)
+{ if (weights.sparse)
+  { memset(into, 0, length * sizeof(float));
+    weights.sparse_weights.gather(into, 0, 1);
+  }
   else
-    do_weighting(all, length, local_weights, weights.dense_weights);
-    
-  if (weights.sparse)
-    cout << "sparse parameters not supported with parallel computation!" << endl;
+    for (uint64_t i = 0; i < length; i++)
+      into[i] = weights.dense_weights[i << weights.dense_weights.stride_shift()];
+}
+
+void set_weights(parameters& weights, float* from, uint64_t length)
+{ if (weights.sparse)
+    weights.sparse_weights.scatter(from, 0, 1);
   else
-    all_reduce<float, add_float>(all, weights.dense_weights.first(), length*weights.stride_shift()); 
-  delete[] local_weights;
+    for (uint64_t i = 0; i < length; i++)
+      weights.dense_weights[i << weights.dense_weights.stride_shift()] = from[i];
+}
+
+async_avg* create_async_avg(vw& all)
+{ async_avg* a = new async_avg();
+  a->all = &all;
+  uint64_t length = (uint64_t)1 << all.num_bits;
+  a->snapshot = calloc_or_throw<float>(length);
+  a->sum = calloc_or_throw<float>(length);
+  a->in_flight = false;
+  a->random_state = all.random_seed;
+  a->reduce_seconds = a->wait_seconds = 0.;
+  return a;
 }
 
+void start_async_avg(async_avg& a, parameters& weights)
+{ uint64_t length = (uint64_t)1 << a.all->num_bits;
+  get_weights(weights, a.snapshot, length);
+  memcpy(a.sum, a.snapshot, length * sizeof(float));
+  a.in_flight = true;
+  a.reducer = std::thread([&a, length]()
+  { chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    try
+    { sum_encoded(*a.all, a.sum, length, 0, a.random_state);
+    }
+    catch (...)
+    { a.failure = std::current_exception();
+    }
+    a.reduce_seconds += seconds_since(begin);
+  });
+}
+
+void fold_async_avg(async_avg& a, parameters& weights)
+{ if (!a.in_flight)
+    return;
+  chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+  a.reducer.join();
+  a.wait_seconds += seconds_since(begin);
+  a.in_flight = false;
+  if (a.failure)
+    rethrow_exception(a.failure);
+
+  uint64_t length = (uint64_t)1 << a.all->num_bits;
+  float numnodes = (float)a.all->all_reduce->total;
+  float* local = new float[length];
+  get_weights(weights, local, length);
+  for (uint64_t i = 0; i < length; i++)
+    local[i] = a.sum[i] / numnodes + (local[i] - a.snapshot[i]);
+  set_weights(weights, local, length);
+  delete[] local;
+}
+
+void destroy_async_avg(async_avg* a)
+{ if (a->in_flight)
+    a->reducer.join();
+  if (!a->all->quiet)
+    a->all->trace_message << "async allreduce hid " << a->reduce_seconds - a->wait_seconds << " of "
+                          << a->reduce_seconds << " seconds spent averaging" << endl;
+  free(a->snapshot);
+  free(a->sum);
+  delete a;
+}
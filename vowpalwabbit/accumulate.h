@@ -11,3 +11,15 @@ void accumulate(vw& all, parameters& weights, size_t o);
 float accumulate_scalar(vw& all, float local_sum);
 void accumulate_weighted_avg(vw& all, parameters& weights);
 void accumulate_avg(vw& all, parameters& weights, size_t o);
+
+// Averages the weights over the nodes on a thread of its own while the next pass learns, so a
+// pass waits only for what is left of the average the pass before started.
+struct async_avg;
+async_avg* create_async_avg(vw& all);
+// Waits for the average in flight, if any, and folds it into the weights, keeping what this node
+// learned since it started.
+void fold_async_avg(async_avg& a, parameters& weights);
+// Starts averaging the weights as they are now.
+void start_async_avg(async_avg& a, parameters& weights);
+// Reports how much of the averaging was hidden behind learning.
+void destroy_async_avg(async_avg* a);
@@ -39,15 +39,31 @@ typedef int socket_t;
 #define CLOSESOCK close
 #include <future>
 #endif
+#include <vector>
+#include <cstring>
 #include "vw_exception.h"
 #include <assert.h>
 
 const size_t ar_buf_size = 1<<16;
+const size_t shm_slot_bytes = 1<<20; // of each node's part of the memory the nodes of a host share
+
+// How AllReduceSockets combines the vectors of the nodes: up the spanning tree and back down, or
+// around a ring of all the nodes as a reduce-scatter and then an allgather.  The tree sends the
+// whole vector twice over the links of its root; the ring sends 2 (total - 1) / total of it over
+// every link.  SharedMemory sums the vectors of the nodes on each host in memory they share, and
+// the first node of each host sums those around a ring of the hosts.
+enum AllReduceAlgorithm
+{ Tree,
+  Ring,
+  SharedMemory
+};
 
 struct node_socks
 { std::string current_master;
   socket_t parent;
   socket_t children[2];
+  socket_t ring_next; // connected when a ring all_reduce first runs
+  socket_t ring_prev;
   ~node_socks()
   { if(current_master != "")
     { if(parent != -1)
@@ -56,13 +72,24 @@ struct node_socks
         CLOSESOCK(this->children[0]);
       if(children[1] != -1)
         CLOSESOCK(this->children[1]);
+      if(ring_next != -1)
+        CLOSESOCK(this->ring_next);
+      if(ring_prev != -1)
+        CLOSESOCK(this->ring_prev);
     }
   }
   node_socks ()
   { current_master = "";
+    ring_next = ring_prev = -1;
   }
 };
 
+// An entry of a vector which the nodes sum as lists of the entries they changed, sorted by index.
+struct sparse_entry
+{ uint32_t index;
+  float value;
+};
+
 template <class T, void(*f)(T&, const T&)> void addbufs(T* buf1, const T* buf2, const size_t n)
 { for (size_t i = 0; i < n; i++)
     f(buf1[i], buf2[i]);
@@ -174,8 +201,84 @@ private:
   node_socks socks;
   std::string span_server;
   size_t unique_id; //unique id for each node in the network, id == 0 means extra io.
+  AllReduceAlgorithm algorithm;
+  std::string host; // nodes naming the same host share memory, by default those with the same local_ip
+  uint32_t local_ip; // the address its tree parent, or for the root the span server, saw this node at, network order
+  std::vector<char> ring_scratch; // a chunk received from ring_prev before it is reduced
+  size_t ring_total; // nodes in the ring, 0 until ring_init
+  size_t ring_node;  // this node's place in it
+  char* shm;         // mapped by shm_init
+  size_t shm_bytes;
+  size_t local_total; // nodes sharing shm
+  size_t local_rank;  // this node's slot in it
+  size_t hosts;       // in the ring of the first nodes of each host
 
   void all_reduce_init();
+  // connects members, which every node passes the same of, into a ring in their order
+  void ring_init(const std::vector<size_t>& members);
+  // sends out_bytes of out to ring_next while receiving in_bytes from ring_prev into in
+  void ring_exchange(const char* out, size_t out_bytes, char* in, size_t in_bytes);
+  void shm_init();
+  // returns once every node of the host has called it
+  void shm_barrier();
+  char* shm_slot(size_t rank) { return shm + 64 + rank * shm_slot_bytes; }
+
+  // the first element of chunk c of n elements split over the ring
+  size_t ring_chunk(size_t c, size_t n) { return c * n / ring_total; }
+
+  template <class T, void(*f)(T&, const T&)> void ring_all_reduce(T* buffer, const size_t n)
+  { const size_t total = ring_total, node = ring_node;
+    ring_scratch.resize((n / total + 1) * sizeof(T));
+    T* scratch = (T*)ring_scratch.data();
+
+    // reduce-scatter: each step adds the chunk ring_prev has summed so far into ours, so after
+    // total - 1 steps this node holds chunk node + 1 summed over every node
+    for (size_t s = 0; s + 1 < total; s++)
+    { size_t out = (node + total - s) % total;
+      size_t in = (node + 2 * total - s - 1) % total;
+      size_t out_begin = ring_chunk(out, n), in_begin = ring_chunk(in, n);
+      size_t in_count = ring_chunk(in + 1, n) - in_begin;
+      ring_exchange((char*)(buffer + out_begin), (ring_chunk(out + 1, n) - out_begin) * sizeof(T),
+                    (char*)scratch, in_count * sizeof(T));
+      addbufs<T, f>(buffer + in_begin, scratch, in_count);
+    }
+
+    // allgather: pass the summed chunks on around the ring, each replacing what the node had
+    for (size_t s = 0; s + 1 < total; s++)
+    { size_t out = (node + 1 + total - s) % total;
+      size_t in = (node + total - s) % total;
+      size_t out_begin = ring_chunk(out, n), in_begin = ring_chunk(in, n);
+      ring_exchange((char*)(buffer + out_begin), (ring_chunk(out + 1, n) - out_begin) * sizeof(T),
+                    (char*)(buffer + in_begin), (ring_chunk(in + 1, n) - in_begin) * sizeof(T));
+    }
+  }
+
+  template <class T, void(*f)(T&, const T&)> void shm_all_reduce(T* buffer, const size_t n)
+  { const size_t chunk = shm_slot_bytes / sizeof(T);
+    T* sum = (T*)shm_slot(0);
+    for (size_t begin = 0; begin < n; begin += chunk)
+    { size_t count = (std::min)(chunk, n - begin);
+      memcpy(shm_slot(local_rank), buffer + begin, count * sizeof(T));
+      shm_barrier();
+
+      // each node of the host adds its share of the chunk in the other slots into the first
+      size_t share_begin = local_rank * count / local_total;
+      size_t share_end = (local_rank + 1) * count / local_total;
+      for (size_t r = 1; r < local_total; r++)
+        addbufs<T, f>(sum + share_begin, (T*)shm_slot(r) + share_begin, share_end - share_begin);
+      shm_barrier();
+
+      if (hosts > 1)
+      { if (local_rank == 0)
+          ring_all_reduce<T, f>(sum, count);
+        shm_barrier();
+      }
+
+      memcpy(buffer + begin, sum, count * sizeof(T));
+      // no node may overwrite its slot with the next chunk until every node has read this one
+      shm_barrier();
+    }
+  }
 
   template <class T> void pass_up(char* buffer, size_t left_read_pos, size_t right_read_pos, size_t& parent_sent_pos)
   { size_t my_bufsize = (std::min)(ar_buf_size, (std::min)(left_read_pos, right_read_pos) / sizeof(T) * sizeof(T) - parent_sent_pos);
@@ -262,19 +365,41 @@ private:
   void broadcast(char* buffer, const size_t n);
 
 public:
-  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode)
-    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id)
+  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode,
+                   AllReduceAlgorithm palgorithm = Tree, std::string phost = "")
+    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id), algorithm(palgorithm), host(phost),
+      local_ip(0), ring_total(0), ring_node(0), shm(nullptr), shm_bytes(0), local_total(1), local_rank(0), hosts(1)
   {
   }
 
-  virtual ~AllReduceSockets()
-  {
-  }
+  virtual ~AllReduceSockets();
 
   template <class T, void(*f)(T&, const T&)> void all_reduce(T* buffer, const size_t n)
   { if (span_server != socks.current_master)
       all_reduce_init();
+    // short vectors take the tree, whose depth costs less than the 2 (total - 1) steps of the ring
+    if (algorithm == Ring && total > 1 && n * sizeof(T) >= ar_buf_size)
+    { if (ring_total == 0)
+      { std::vector<size_t> everyone;
+        for (size_t i = 0; i < total; i++)
+          everyone.push_back(i);
+        ring_init(everyone);
+      }
+      ring_all_reduce<T, f>(buffer, n);
+      return;
+    }
+    if (algorithm == SharedMemory && total > 1 && n * sizeof(T) >= ar_buf_size)
+    { if (shm == nullptr)
+        shm_init();
+      shm_all_reduce<T, f>(buffer, n);
+      return;
+    }
     reduce<T, f>((char*)buffer, n*sizeof(T));
     broadcast((char*)buffer, n*sizeof(T));
   }
+
+  // Sums vectors given as their changed entries sorted by index.  Each node merges the lists of
+  // its children into its own and passes the result up the tree, and the root's list comes back
+  // down, so a link carries only the entries changed below it rather than the whole vector.
+  void sparse_all_reduce(std::vector<sparse_entry>& entries);
 };
@@ -15,6 +15,7 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
 #ifdef _WIN32
 #include <WinSock2.h>
 #include <Windows.h>
@@ -22,7 +23,17 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <io.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
+#include <sched.h>
+#include <climits>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 #endif
 #include <sys/timeb.h>
 #include "allreduce.h"
@@ -96,6 +107,65 @@ socket_t getsock()
   return sock;
 }
 
+// listens on netport, or the first free port above it, which netport is set to
+socket_t listen_from(short unsigned int& netport, int backlog)
+{ socket_t sock = getsock();
+  sockaddr_in address;
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = netport;
+
+  bool listening = false;
+  while(!listening)
+  { if (::bind(sock,(sockaddr*)&address, sizeof(address)) < 0)
+    {
+#ifdef _WIN32
+      if (WSAGetLastError() == WSAEADDRINUSE)
+#else
+      if (errno == EADDRINUSE)
+#endif
+      { netport = htons(ntohs(netport)+1);
+        address.sin_port = netport;
+      }
+      else
+        THROWERRNO("bind");
+    }
+    else
+    { if (listen(sock, backlog) < 0)
+      { cerr << "listen: " << strerror(errno) << endl;
+        CLOSESOCK(sock);
+        sock = getsock();
+      }
+      else
+      { listening = true;
+      }
+    }
+  }
+  return sock;
+}
+
+void set_nonblocking(socket_t sock)
+{
+#ifdef _WIN32
+  u_long on = 1;
+  if (ioctlsocket(sock, FIONBIO, &on) != 0)
+    THROW("ioctlsocket FIONBIO failed");
+#else
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)
+    THROWERRNO("fcntl O_NONBLOCK");
+#endif
+}
+
+bool would_block()
+{
+#ifdef _WIN32
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
 void AllReduceSockets::all_reduce_init()
 {
 #ifdef _WIN32
@@ -117,6 +187,11 @@ void AllReduceSockets::all_reduce_init()
   int port = 26543;
 
   socket_t master_sock = sock_connect(master_ip, htons(port));
+  sockaddr_in local_address;
+  socklen_t local_size = sizeof(local_address);
+  if (getsockname(master_sock, (sockaddr*)&local_address, &local_size) < 0)
+    THROWERRNO("getsockname");
+  local_ip = local_address.sin_addr.s_addr;
   if(send(master_sock, (const char*)&unique_id, sizeof(unique_id), 0) < (int)sizeof(unique_id))
     cerr << "write unique_id=" << unique_id << " failed!" << endl;
   else cerr << "wrote unique_id=" << unique_id << endl;
@@ -144,39 +219,7 @@ void AllReduceSockets::all_reduce_init()
   socket_t sock = -1;
   short unsigned int netport = htons(26544);
   if(kid_count > 0)
-  { sock = getsock();
-    sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = netport;
-
-    bool listening = false;
-    while(!listening)
-    { if (::bind(sock,(sockaddr*)&address, sizeof(address)) < 0)
-      {
-#ifdef _WIN32
-        if (WSAGetLastError() == WSAEADDRINUSE)
-#else
-        if (errno == EADDRINUSE)
-#endif
-        { netport = htons(ntohs(netport)+1);
-          address.sin_port = netport;
-        }
-        else
-          THROWERRNO("bind");
-      }
-      else
-      { if (listen(sock, kid_count) < 0)
-        { cerr << "listen: " << strerror(errno) << endl;
-          CLOSESOCK(sock);
-          sock = getsock();
-        }
-        else
-        { listening = true;
-        }
-      }
-    }
-  }
+    sock = listen_from(netport, kid_count);
 
   if(send(master_sock, (const char*)&netport, sizeof(netport), 0) < (int)sizeof(netport))
     cerr << "write netport failed!" << endl;
@@ -197,8 +240,15 @@ void AllReduceSockets::all_reduce_init()
 
   CLOSESOCK(master_sock);
 
+  // The ring advertises a node by the address its parent saw it connect from, and the root by the
+  // one the span server saw, which its children were given.  That this node reached the span
+  // server from is loopback when both run on one host, which other hosts can not connect to.
   if(parent_ip != (uint32_t)-1)
   { socks.parent = sock_connect(parent_ip, parent_port);
+    if (send(socks.parent, (const char*)&parent_ip, sizeof(parent_ip), 0) < (int)sizeof(parent_ip))
+      THROWERRNO("send parent address");
+    if (recv(socks.parent, (char*)&local_ip, sizeof(local_ip), MSG_WAITALL) < (int)sizeof(local_ip))
+      THROWERRNO("recv own address");
   }
   else
     socks.parent = -1;
@@ -216,6 +266,13 @@ void AllReduceSockets::all_reduce_init()
     // getnameinfo((sockaddr *) &child_address, sizeof(sockaddr), hostname, NI_MAXHOST, servInfo, NI_MAXSERV, NI_NUMERICSERV);
     // cerr << "connected to " << hostname << ':' << ntohs(port) << endl;
     socks.children[i] = f;
+    uint32_t seen_ip;
+    if (recv(f, (char*)&seen_ip, sizeof(seen_ip), MSG_WAITALL) < (int)sizeof(seen_ip))
+      THROWERRNO("recv own address");
+    if (socks.parent == -1)
+      local_ip = seen_ip;
+    if (send(f, (const char*)&child_address.sin_addr.s_addr, sizeof(uint32_t), 0) < (int)sizeof(uint32_t))
+      THROWERRNO("send child address");
   }
 
   if (kid_count > 0)
@@ -271,3 +328,294 @@ void AllReduceSockets::broadcast(char* buffer, const size_t n)
     }
   }
 }
+
+void add_address(uint64_t& a, const uint64_t& b) { a += b; }
+
+void AllReduceSockets::ring_init(const vector<size_t>& members)
+{ ring_node = find(members.begin(), members.end(), node) - members.begin();
+  bool member = ring_node < members.size() && members.size() > 1;
+  short unsigned int netport = htons(26544);
+  socket_t sock = -1;
+  if (member)
+    sock = listen_from(netport, 1);
+
+  // the address of every member, gathered through the tree
+  vector<uint64_t> addresses(total, 0);
+  if (member)
+    addresses[node] = ((uint64_t)local_ip << 16) | netport;
+  reduce<uint64_t, add_address>((char*)addresses.data(), total * sizeof(uint64_t));
+  broadcast((char*)addresses.data(), total * sizeof(uint64_t));
+  if (!member)
+  { ring_total = 1;
+    ring_node = 0;
+    return;
+  }
+  ring_total = members.size();
+  bool loopback = false, remote = false;
+  for (size_t m : members)
+    if ((ntohl((uint32_t)(addresses[m] >> 16)) >> 24) == 127)
+      loopback = true;
+    else
+      remote = true;
+  if (loopback && remote)
+    THROW("ring nodes on other hosts can not connect to one seen at a loopback address; give --span_server an address every host reaches it by");
+
+  // connecting completes in the listen backlog of the next node, so every node can connect before
+  // any accepts
+  uint64_t next = addresses[members[(ring_node + 1) % ring_total]];
+  socks.ring_next = sock_connect((uint32_t)(next >> 16), (int)(next & 0xffff));
+
+  sockaddr_in prev_address;
+  socklen_t size = sizeof(prev_address);
+  socks.ring_prev = accept(sock, (sockaddr*)&prev_address, &size);
+  if (socks.ring_prev < 0)
+    THROWERRNO("accept");
+  CLOSESOCK(sock);
+
+  // each node sends to the next while the previous sends to it, so a blocking send could wait on
+  // a node itself waiting to send
+  set_nonblocking(socks.ring_next);
+  set_nonblocking(socks.ring_prev);
+}
+
+void AllReduceSockets::ring_exchange(const char* out, size_t out_bytes, char* in, size_t in_bytes)
+{ size_t sent = 0;
+  size_t received = 0;
+  socket_t max_fd = (std::max)(socks.ring_next, socks.ring_prev) + 1;
+  while (sent < out_bytes || received < in_bytes)
+  { fd_set readable, writable;
+    FD_ZERO(&readable);
+    FD_ZERO(&writable);
+    if (sent < out_bytes)
+      FD_SET(socks.ring_next, &writable);
+    if (received < in_bytes)
+      FD_SET(socks.ring_prev, &readable);
+    if (select((int)max_fd, &readable, &writable, nullptr, nullptr) == -1)
+      THROWERRNO("select");
+
+    if (FD_ISSET(socks.ring_next, &writable))
+    { int write_size = send(socks.ring_next, out + sent, (int)min(ar_buf_size, out_bytes - sent), 0);
+      if (write_size < 0 && !would_block())
+        THROWERRNO("send to next ring node");
+      if (write_size > 0)
+        sent += write_size;
+    }
+    if (FD_ISSET(socks.ring_prev, &readable))
+    { int read_size = recv(socks.ring_prev, in + received, (int)min(ar_buf_size, in_bytes - received), 0);
+      if (read_size == 0)
+        THROW("previous ring node closed its connection");
+      if (read_size < 0 && !would_block())
+        THROWERRNO("recv from previous ring node");
+      if (read_size > 0)
+        received += read_size;
+    }
+  }
+}
+
+void send_all(socket_t sock, const char* buffer, size_t n, const char* to)
+{ while (n > 0)
+  { int write_size = send(sock, buffer, (int)min(ar_buf_size, n), 0);
+    if (write_size < 0)
+      THROWERRNO("send to " << to);
+    buffer += write_size;
+    n -= write_size;
+  }
+}
+
+void recv_all(socket_t sock, char* buffer, size_t n, const char* from)
+{ while (n > 0)
+  { int read_size = recv(sock, buffer, (int)min(ar_buf_size, n), 0);
+    if (read_size == 0)
+      THROW(from << " closed its connection");
+    if (read_size < 0)
+      THROWERRNO("recv from " << from);
+    buffer += read_size;
+    n -= read_size;
+  }
+}
+
+void send_entries(socket_t sock, vector<sparse_entry>& entries, const char* to)
+{ uint64_t count = entries.size();
+  send_all(sock, (const char*)&count, sizeof(count), to);
+  send_all(sock, (const char*)entries.data(), entries.size() * sizeof(sparse_entry), to);
+}
+
+void recv_entries(socket_t sock, vector<sparse_entry>& entries, const char* from)
+{ uint64_t count;
+  recv_all(sock, (char*)&count, sizeof(count), from);
+  entries.resize(count);
+  recv_all(sock, (char*)entries.data(), count * sizeof(sparse_entry), from);
+}
+
+// adds the sorted entries b into the sorted entries a, using merged as scratch
+void merge_entries(vector<sparse_entry>& a, const vector<sparse_entry>& b, vector<sparse_entry>& merged)
+{ merged.clear();
+  merged.reserve(a.size() + b.size());
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size())
+  { if (a[i].index < b[j].index)
+      merged.push_back(a[i++]);
+    else if (b[j].index < a[i].index)
+      merged.push_back(b[j++]);
+    else
+    { sparse_entry sum = { a[i].index, a[i].value + b[j].value };
+      merged.push_back(sum);
+      i++;
+      j++;
+    }
+  }
+  merged.insert(merged.end(), a.begin() + i, a.end());
+  merged.insert(merged.end(), b.begin() + j, b.end());
+  a.swap(merged);
+}
+
+void AllReduceSockets::sparse_all_reduce(vector<sparse_entry>& entries)
+{ if (span_server != socks.current_master)
+    all_reduce_init();
+
+  // a child blocks sending until its parent reads it, which the parent does child by child
+  vector<sparse_entry> child, merged;
+  for (int i = 0; i < 2; i++)
+    if (socks.children[i] != -1)
+    { recv_entries(socks.children[i], child, "child");
+      merge_entries(entries, child, merged);
+    }
+
+  if (socks.parent != -1)
+  { send_entries(socks.parent, entries, "parent");
+    recv_entries(socks.parent, entries, "parent");
+  }
+
+  for (int i = 0; i < 2; i++)
+    if (socks.children[i] != -1)
+      send_entries(socks.children[i], entries, "child");
+}
+
+AllReduceSockets::~AllReduceSockets()
+{
+#ifndef _WIN32
+  if (shm != nullptr)
+    munmap(shm, shm_bytes);
+#endif
+}
+
+#ifndef _WIN32
+// the start of the memory the nodes of a host share, before their slots
+struct shm_header
+{ atomic<uint32_t> arrived;    // at the barrier
+  atomic<uint32_t> generation; // of the barrier, which the last node to arrive advances
+};
+static_assert(sizeof(shm_header) <= 64, "shm_slot starts the slots 64 bytes in");
+
+void wait_while_equal(atomic<uint32_t>& word, uint32_t value)
+{ for (size_t spins = 0; word.load(memory_order_acquire) == value; spins++)
+    if (spins >= 1000) // the other nodes are slow enough to sleep on
+    {
+#ifdef __linux__
+      syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, value, nullptr, nullptr, 0);
+#else
+      sched_yield();
+#endif
+    }
+}
+
+void wake_all(atomic<uint32_t>& word)
+{
+#ifdef __linux__
+  syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+uint64_t host_key(const string& host, uint32_t local_ip)
+{ if (host.empty())
+    return local_ip;
+  uint64_t key = 14695981039346656037ULL; // FNV-1a
+  for (char c : host)
+  { key ^= (unsigned char)c;
+    key *= 1099511628211ULL;
+  }
+  return key;
+}
+#endif
+
+void AllReduceSockets::shm_barrier()
+{
+#ifndef _WIN32
+  shm_header& header = *(shm_header*)shm;
+  uint32_t generation = header.generation.load(memory_order_acquire);
+  if (header.arrived.fetch_add(1, memory_order_acq_rel) + 1 == local_total)
+  { header.arrived.store(0, memory_order_relaxed);
+    header.generation.fetch_add(1, memory_order_release);
+    wake_all(header.generation);
+  }
+  else
+    wait_while_equal(header.generation, generation);
+#endif
+}
+
+void AllReduceSockets::shm_init()
+{
+#ifdef _WIN32
+  THROW("--allreduce shm needs POSIX shared memory");
+#else
+  // which nodes share a host, followed by the pid of each node, gathered through the tree
+  vector<uint64_t> keys(2 * total, 0);
+  keys[node] = host_key(host, local_ip);
+  keys[total + node] = (uint64_t)getpid();
+  reduce<uint64_t, add_address>((char*)keys.data(), 2 * total * sizeof(uint64_t));
+  broadcast((char*)keys.data(), 2 * total * sizeof(uint64_t));
+
+  vector<size_t> leaders; // the first node of each host
+  size_t leader = node;
+  local_total = 0;
+  local_rank = 0;
+  for (size_t i = 0; i < total; i++)
+  { if (find(keys.begin(), keys.begin() + i, keys[i]) == keys.begin() + i)
+      leaders.push_back(i);
+    if (keys[i] == keys[node])
+    { if (local_total == 0)
+        leader = i;
+      if (i < node)
+        local_rank++;
+      local_total++;
+    }
+  }
+  hosts = leaders.size();
+
+  stringstream name;
+  // the pid of the first node of the host tells apart jobs running there with the same unique_id
+  name << "/vw_allreduce." << unique_id << "." << leader << "." << keys[total + leader];
+  shm_bytes = 64 + local_total * shm_slot_bytes;
+  int fd = -1;
+  if (local_rank == 0)
+  { shm_unlink(name.str().c_str()); // left by a job which died, its leader having had this pid
+    fd = shm_open(name.str().c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      THROWERRNO("shm_open(" << name.str() << ")");
+    if (ftruncate(fd, shm_bytes) < 0) // which zeroes the barrier
+      THROWERRNO("ftruncate(" << name.str() << ")");
+  }
+
+  // the tree orders the first node of each host creating its memory before the others open it,
+  // and them opening it before it is unlinked, so that none is left behind
+  uint64_t barrier = 0;
+  reduce<uint64_t, add_address>((char*)&barrier, sizeof(barrier));
+  broadcast((char*)&barrier, sizeof(barrier));
+  if (local_rank != 0)
+  { fd = shm_open(name.str().c_str(), O_RDWR, 0);
+    if (fd < 0)
+      THROWERRNO("shm_open(" << name.str() << ")");
+  }
+  void* mapped = mmap(nullptr, shm_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    THROWERRNO("mmap(" << name.str() << ")");
+  shm = (char*)mapped;
+  reduce<uint64_t, add_address>((char*)&barrier, sizeof(barrier));
+  broadcast((char*)&barrier, sizeof(barrier));
+  if (local_rank == 0)
+    shm_unlink(name.str().c_str());
+
+  ring_init(leaders);
+#endif
+}
@@ -1,8 +1,12 @@
 #pragma once
 #include <string.h>
-#include <unordered_map>
+#include <vector>
+#include "weight_memory.h"
+#include "vw_exception.h"
 #ifndef _WIN32
 #include <sys/mman.h>
+#else
+#include <xmmintrin.h>
 #endif
 
 // It appears that on OSX MAP_ANONYMOUS is mapped to MAP_ANON
@@ -13,9 +17,14 @@
 
 typedef float weight;
 
+// Hashed features touch the weights in no particular order, so once the table outgrows the
+// caches the loops over an example's features prefetch the weights of the feature this many
+// positions ahead.
+const size_t prefetch_ahead = 8;
+const uint64_t prefetch_min_weights = (uint64_t)1 << 23;
+
 class dense_parameters;
 class sparse_parameters;
-typedef std::unordered_map<uint64_t, weight*> weight_map;
 
 class weight_iterator_iterator
 {
@@ -94,6 +103,7 @@ private:
 	uint64_t _weight_mask;  // (stride*(1 << num_bits) -1)
 	uint32_t _stride_shift;
 	bool _seeded; // whether the instance is sharing model state with others
+	size_t _mapped; // length of the mapping backing _begin, 0 if it came from the heap
 
  public:
 	typedef dense_iterator<weight> iterator;
@@ -101,12 +111,28 @@ private:
  dense_parameters(size_t length, uint32_t stride_shift=0)
    : _begin(calloc_mergable_or_throw<weight>(length << stride_shift)),
 	  _weight_mask((length << stride_shift) - 1),	
+	  _stride_shift(stride_shift),
+	  _seeded(false),
+	  _mapped(0)
+	    { }
+
+ dense_parameters(size_t length, uint32_t stride_shift, weight_memory& memory)
+   : _weight_mask((length << stride_shift) - 1),
 	  _stride_shift(stride_shift),
 	  _seeded(false)
+	    { _begin = (weight*)alloc_weights((length << stride_shift) * sizeof(weight), memory, _mapped); }
+	
+ // adopts a table from map_model_weights
+ dense_parameters(weight* table, size_t length, uint32_t stride_shift, size_t mapped)
+   : _begin(table),
+	  _weight_mask((length << stride_shift) - 1),
+	  _stride_shift(stride_shift),
+	  _seeded(false),
+	  _mapped(mapped)
 	    { }
 	
  dense_parameters()
-	 : _begin(nullptr), _weight_mask(0), _stride_shift(0),_seeded(false)
+	 : _begin(nullptr), _weight_mask(0), _stride_shift(0),_seeded(false), _mapped(0)
 	  {}
 	
 	bool not_null() { return (_weight_mask > 0 && _begin != nullptr);}
@@ -125,14 +151,26 @@ private:
 	const_iterator cend() { return const_iterator(_begin + _weight_mask + 1, _begin, stride()); }
 
 	inline weight& operator[](size_t i) const { return _begin[i & _weight_mask]; }
+
+	bool prefetching() const { return _weight_mask >= prefetch_min_weights; }
+
+	inline void prefetch(size_t i) const
+	{
+#ifdef _WIN32
+	  _mm_prefetch((const char*)&_begin[i & _weight_mask], _MM_HINT_T0);
+#else
+	  __builtin_prefetch(&_begin[i & _weight_mask]);
+#endif
+	}
 	void shallow_copy(const dense_parameters& input)
 	{ 
 	  if (!_seeded)
-		  free(_begin);
+		  free_weights(_begin, _mapped);
 	  _begin = input._begin;
 	  _weight_mask = input._weight_mask;
 	  _stride_shift = input._stride_shift;
 	  _seeded = true;
+	  _mapped = input._mapped;
 	}
 
 	inline weight& strided_index(size_t index){ return operator[](index << _stride_shift);}
@@ -175,26 +213,41 @@ private:
           size_t float_count = length << _stride_shift;
       	  weight* dest = shared_weights;
 		  memcpy(dest, _begin, float_count*sizeof(float));
-      	  free(_begin);
+      	  free_weights(_begin, _mapped);
       	  _begin = dest;
+      	  _mapped = 0;
 	}
 	#endif
 	
 	~dense_parameters()
 	{  if (_begin != nullptr && !_seeded)  // don't free weight vector if it is shared with another instance
-	   {  free(_begin);
+	   {  free_weights(_begin, _mapped);
 	      _begin = nullptr;
 	   }
 	}
 };
 
+// A slot of the table of sparse_parameters: the stride of weights of the masked index key,
+// or a free slot while block is nullptr.
+struct sparse_slot
+{ uint64_t key;
+  weight* block;
+};
+
 template <typename T>
 class sparse_iterator
 {
 private:
-	weight_map::iterator _iter;
+	sparse_slot* _slot;
+	sparse_slot* _end;
 	uint32_t _stride;
 
+	void skip_free()
+	{
+		while (_slot != _end && _slot->block == nullptr)
+			++_slot;
+	}
+
 public:
 	typedef std::forward_iterator_tag iterator_category;
 	typedef T value_type;
@@ -204,107 +257,178 @@ public:
 
 	typedef weight_iterator_iterator w_iter;
 
-	sparse_iterator(weight_map::iterator& iter, uint32_t stride)
-		: _iter(iter), _stride(stride)
-	{ }
-
-	sparse_iterator& operator=(const sparse_iterator& other)
-	{
-		_iter = other._iter;
-		_stride = other._stride;
-		return *this;
+	sparse_iterator(sparse_slot* slot, sparse_slot* end, uint32_t stride)
+		: _slot(slot), _end(end), _stride(stride)
+	{ skip_free(); }
 
-	}
-	uint64_t index() { return _iter->first; }
+	uint64_t index() { return _slot->key; }
 
-	T& operator*() { return *(_iter->second); } 
+	T& operator*() { return *(_slot->block); }
 
 	sparse_iterator& operator++()
-	{  
-		_iter++;
+	{
+		++_slot;
+		skip_free();
 		return *this;
 	}
 
-	bool operator==(const sparse_iterator& rhs) const { return _iter == rhs._iter; }
-	bool operator!=(const sparse_iterator& rhs) const { return _iter != rhs._iter; }
+	bool operator==(const sparse_iterator& rhs) const { return _slot == rhs._slot; }
+	bool operator!=(const sparse_iterator& rhs) const { return _slot != rhs._slot; }
 
 	//to iterate within a bucket
-	w_iter begin() { return w_iter(_iter->second);}
-	w_iter end() { return w_iter(_iter->second + _stride); }
-	w_iter end(size_t offset) { return w_iter(_iter->second + offset);}
+	w_iter begin() { return w_iter(_slot->block);}
+	w_iter end() { return w_iter(_slot->block + _stride); }
+	w_iter end(size_t offset) { return w_iter(_slot->block + offset);}
 };
 
+const uint32_t sparse_initial_slot_bits = 10;
+const size_t sparse_slab_strides = 1 << 12;
 
+// The strides of weights that have been touched, in an open-addressing table probed linearly
+// from a Fibonacci hash of the index, which doubles once three quarters full.  Strides are carved out of
+// slabs and never move, so references to weights stay valid while the table grows.
 class sparse_parameters
 {
 private:
-	weight_map _map;
+	sparse_slot* _slots;
+	uint32_t _slot_bits;          // the table has 1 << _slot_bits slots
+	size_t _used;                 // slots holding a stride
+	std::vector<weight*> _slabs;  // allocated by this instance
+	size_t _slab_left;            // strides not yet handed out of _slabs.back()
 	uint64_t _weight_mask;  // (stride*(1 << num_bits) -1)
 	uint32_t _stride_shift;
 	bool _seeded; // whether the instance is sharing model state with others
-	bool _delete;
 	void* default_data;
 public:
 	typedef sparse_iterator<weight> iterator;
 	typedef sparse_iterator<const weight> const_iterator;
  private:
 	void(*fun)(iterator&, void*);
+
+	size_t slots() const { return _slots == nullptr ? 0 : (size_t)1 << _slot_bits; }
+
+	// the slot of key, or the free slot where it belongs
+	sparse_slot* find_slot(uint64_t key) const
+	{
+		size_t mask = slots() - 1;
+		for (size_t s = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - _slot_bits));; s = (s + 1) & mask)
+			if (_slots[s].block == nullptr || _slots[s].key == key)
+				return &_slots[s];
+	}
+
+	void grow()
+	{
+		sparse_slot* old = _slots;
+		size_t old_slots = slots();
+		_slot_bits = old == nullptr ? sparse_initial_slot_bits : _slot_bits + 1;
+		_slots = calloc_or_throw<sparse_slot>((size_t)1 << _slot_bits);
+		for (size_t s = 0; s < old_slots; s++)
+			if (old[s].block != nullptr)
+				*find_slot(old[s].key) = old[s];
+		free(old);
+	}
+
+	weight* insert(uint64_t index)
+	{
+		if (4 * (_used + 1) > 3 * slots())
+			grow();
+		if (_slab_left == 0)
+		{
+			_slabs.push_back(calloc_mergable_or_throw<weight>(sparse_slab_strides << _stride_shift));
+			_slab_left = sparse_slab_strides;
+		}
+		sparse_slot* slot = find_slot(index);
+		slot->key = index;
+		slot->block = _slabs.back() + ((sparse_slab_strides - _slab_left--) << _stride_shift);
+		_used++;
+		if (fun != nullptr)
+		{
+			iterator i(slot, slot + 1, stride());
+			fun(i, default_data);
+		}
+		return slot->block;
+	}
+
+	void free_table()
+	{
+		for (weight* slab : _slabs)
+			free(slab);
+		_slabs.clear();
+		_slab_left = 0;
+		free(_slots);
+		_slots = nullptr;
+		_used = 0;
+	}
+
  public:
 
 	sparse_parameters(size_t length, uint32_t stride_shift = 0)
-		: _map(),
+		: _slots(nullptr), _slot_bits(0), _used(0), _slab_left(0),
 		_weight_mask((length << stride_shift) - 1),
 		_stride_shift(stride_shift),
-		_seeded(false), _delete(false),
+		_seeded(false), default_data(nullptr),
 		fun(nullptr)
 	{}
 
 	sparse_parameters()
-		: _map(), _weight_mask(0), _stride_shift(0), _seeded(false), _delete(false), fun(nullptr)
+		: _slots(nullptr), _slot_bits(0), _used(0), _slab_left(0), _weight_mask(0), _stride_shift(0), _seeded(false),
+		default_data(nullptr), fun(nullptr)
 	{}
 
-	bool not_null() { return (_weight_mask > 0 && !_map.empty()); }
+	bool not_null() { return (_weight_mask > 0 && _used > 0); }
 
-	sparse_parameters(const sparse_parameters &other) { shallow_copy(other); }
+	sparse_parameters(const sparse_parameters &other)
+		: _slots(nullptr), _slot_bits(0), _used(0), _slab_left(0), _weight_mask(0), _stride_shift(0), _seeded(false),
+		default_data(nullptr), fun(nullptr)
+	{ shallow_copy(other); }
 	sparse_parameters(sparse_parameters &&) = delete;
 
-	weight* first() { throw 1; } //TODO: Throw better exceptions. Allreduce currently not supported in sparse.
-
 	//iterator with stride 
-	iterator begin() { weight_map::iterator i = _map.begin(); return iterator(i, stride()); }
-	iterator end() { weight_map::iterator i = _map.end(); return iterator(i, stride()); }
+	iterator begin() { return iterator(_slots, _slots + slots(), stride()); }
+	iterator end() { return iterator(_slots + slots(), _slots + slots(), stride()); }
 
 	//const iterator
-	const_iterator cbegin() { weight_map::iterator i = _map.begin(); return const_iterator(i,  stride()); }
-	const_iterator cend() { weight_map::iterator i = _map.begin(); return const_iterator(i, stride()); }
+	const_iterator cbegin() { return const_iterator(_slots, _slots + slots(), stride()); }
+	const_iterator cend() { return const_iterator(_slots + slots(), _slots + slots(), stride()); }
 	
 	inline weight& operator[](size_t i)
 	{   uint64_t index = i & _weight_mask;
-		weight_map::iterator iter = _map.find(index);
-		if (iter == _map.end()) 
-		  {     _map.insert(std::make_pair(index, calloc_mergable_or_throw<weight>(stride())));
-			iter = _map.find(index);
-			if (fun != nullptr)
-			  {
-			    iterator i(iter,stride());
-			    fun(i, default_data);
-			  }
-			iter = _map.find(index);
+		if (_slots != nullptr)
+		{
+			sparse_slot* slot = find_slot(index);
+			if (slot->block != nullptr)
+				return *(slot->block);
 		}
-		return *(iter->second);
+		return *insert(index);
+	}
+
+	// the stride of i if it has been touched, without adding it
+	weight* find(size_t i) const
+	{
+		if (_slots == nullptr)
+			return nullptr;
+		return find_slot(i & _weight_mask)->block;
 	}
 
 	inline weight& strided_index(size_t index) { return operator[](index << _stride_shift); }
-	
+
+	bool prefetching() const { return false; } // a lookup would cost as much as the access
+	inline void prefetch(size_t) const {}
+
+	// the strides touched so far
+	size_t size() const { return _used; }
+
 	void shallow_copy(const sparse_parameters& input)
 	{
-		// TODO: this is level-1 copy (weight* are stilled shared)
-		if (!_seeded)
+		// level-1 copy: the table is copied, the strides it points to are shared
+		free_table();
+		if (input._slots != nullptr)
 		{
-			for (auto& pair : _map)
-				free(pair.second);
+			_slots = calloc_or_throw<sparse_slot>(input.slots());
+			memcpy(_slots, input._slots, input.slots() * sizeof(sparse_slot));
 		}
-		_map = input._map;
+		_slot_bits = input._slot_bits;
+		_used = input._used;
 		_weight_mask = input._weight_mask;
 		_stride_shift = input._stride_shift;
 		_seeded = true;
@@ -322,8 +446,37 @@ public:
 
 	void set_zero(size_t offset)
 	{
-		for (weight_map::iterator iter = _map.begin(); iter != _map.end(); ++iter)
-			(&(*(iter->second)))[offset] = 0;
+		for (iterator iter = begin(); iter != end(); ++iter)
+			(&(*iter))[offset] = 0;
+	}
+
+	// For allreduce, which sums dense arrays: copies count weights from offset of every stride
+	// touched into dense, which was zeroed and holds count floats per index, and back again,
+	// adding only the strides that get a nonzero weight.
+	void gather(float* dense, size_t offset, size_t count)
+	{
+		for (iterator iter = begin(); iter != end(); ++iter)
+			memcpy(dense + (iter.index() >> _stride_shift) * count, &(*iter) + offset, count * sizeof(float));
+	}
+
+	void scatter(const float* dense, size_t offset, size_t count)
+	{
+		size_t length = (_weight_mask + 1) >> _stride_shift;
+		for (size_t i = 0; i < length; i++)
+		{
+			const float* values = dense + i * count;
+			weight* block = find(i << _stride_shift);
+			if (block == nullptr)
+			{
+				size_t j = 0;
+				while (j < count && values[j] == 0.f)
+					j++;
+				if (j == count)
+					continue;
+				block = &operator[](i << _stride_shift);
+			}
+			memcpy(block + offset, values, count * sizeof(float));
+		}
 	}
 
 	uint64_t mask()	{ return _weight_mask; }
@@ -337,20 +490,13 @@ public:
 	void stride_shift(uint32_t stride_shift) { _stride_shift = stride_shift; }
 
 #ifndef _WIN32
-	void share(size_t length)
-	{throw 1; //TODO: add better exceptions
+	void share(size_t)
+	{ THROW("--sparse_weights can not be shared between processes");
 	}
 #endif
 
 	~sparse_parameters()
-	{if (!_delete && !_seeded)  // don't free weight vector if it is shared with another instance
-		{
-		for (auto& pair : _map)
-			free(pair.second);
-		 _map.clear();
-		 _delete = true;
-		}
-	}
+	{ free_table(); }
 };
 
 class parameters {
@@ -358,6 +504,7 @@ class parameters {
   bool sparse;
   dense_parameters dense_weights;
   sparse_parameters sparse_weights;
+  weight_memory memory; // backing of dense_weights
 
   inline weight& operator[](size_t i)
   {
@@ -3,13 +3,29 @@ Copyright (c) by respective owners including Yahoo!, Microsoft, and
 individual contributors. All rights reserved.  Released under a BSD (revised)
 license as described in the file LICENSE.
  */
+#include "zlib.h"
 #include "cache.h"
 #include "unique_sort.h"
 #include "global_data.h"
 #include "vw.h"
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 using namespace std;
 
+inline int64_t file_seek(int f, int64_t offset, int whence)
+{
+#ifdef _WIN32
+  return _lseeki64(f, offset, whence);
+#else
+  return lseek(f, offset, whence);
+#endif
+}
+
 const size_t int_size = 11;
 const size_t char_size = 2;
 const size_t neg_1 = 1;
@@ -58,12 +74,11 @@ __attribute__((packed))
 #endif
 ;
 
-int read_cached_features(vw* all, v_array<example*>& examples)
-{ example* ae = examples[0];
-  ae->sorted = all->p->sorted_cache;
-  io_buf* input = all->p->input;
+int read_cached_example(vw* all, shared_data* sd, io_buf& cache, example* ae)
+{ ae->sorted = all->p->sorted_cache;
+  io_buf* input = &cache;
 
-  size_t total = all->p->lp.read_cached_label(all->sd, &ae->l, *input);
+  size_t total = all->p->lp.read_cached_label(sd, &ae->l, *input);
   if (total == 0)
     return 0;
   if (read_cached_tag(*input,ae) == 0)
@@ -75,7 +90,7 @@ int read_cached_features(vw* all, v_array<example*>& examples)
   num_indices = *(unsigned char*)c;
   c += sizeof(num_indices);
 
-  all->p->input->set(c);
+  input->set(c);
   for (; num_indices > 0; num_indices--)
   { size_t temp;
     unsigned char index = 0;
@@ -90,7 +105,7 @@ int read_cached_features(vw* all, v_array<example*>& examples)
     features& ours = ae->feature_space[index];
     size_t storage = *(size_t *)c;
     c += sizeof(size_t);
-    all->p->input->set(c);
+    input->set(c);
     total += storage;
     if (buf_read(*input,c,storage) < storage)
     { all->trace_message << "truncated example! wanted: " << storage << " bytes" << endl;
@@ -119,12 +134,284 @@ int read_cached_features(vw* all, v_array<example*>& examples)
       last = i;
       ours.push_back(v,i);
     }
-    all->p->input->set(c);
+    input->set(c);
   }
 
   return (int)total;
 }
 
+unsigned char cache_codec_id(string name)
+{ if (name == "none")
+    return CODEC_NONE;
+  if (name == "zlib")
+    return CODEC_ZLIB;
+  if (name == "lz4")
+  {
+#ifndef HAVE_LZ4
+    THROW("vw was built without lz4 support, try --cache_codec zlib");
+#endif
+    return CODEC_LZ4;
+  }
+  if (name == "zstd")
+  {
+#ifndef HAVE_ZSTD
+    THROW("vw was built without zstd support, try --cache_codec zlib");
+#endif
+    return CODEC_ZSTD;
+  }
+  THROW("unknown cache codec: " << name << ", choose from none, zlib, lz4 and zstd");
+}
+
+// Compress size bytes at src into packed, returning the compressed size.  Every codec runs at its
+// fastest level, the point is to read less than an uncompressed cache, not to save the last byte.
+uint64_t pack_bytes(unsigned char codec, const char* src, uint64_t size, v_array<char>& packed)
+{ switch (codec)
+  { case CODEC_ZLIB:
+    { uLongf bound = compressBound((uLong)size);
+      if ((uint64_t)(packed.end_array - packed.begin()) < bound)
+        packed.resize(bound);
+      if (compress2((Bytef*)packed.begin(), &bound, (const Bytef*)src, (uLong)size, 1) != Z_OK)
+        THROW("failed to compress a cache block");
+      return bound;
+    }
+#ifdef HAVE_LZ4
+    case CODEC_LZ4:
+    { int bound = LZ4_compressBound((int)size);
+      if (packed.end_array - packed.begin() < bound)
+        packed.resize(bound);
+      int n = LZ4_compress_default(src, packed.begin(), (int)size, bound);
+      if (n <= 0)
+        THROW("failed to compress a cache block");
+      return n;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD:
+    { size_t bound = ZSTD_compressBound(size);
+      if ((size_t)(packed.end_array - packed.begin()) < bound)
+        packed.resize(bound);
+      size_t n = ZSTD_compress(packed.begin(), bound, src, size, 1);
+      if (ZSTD_isError(n))
+        THROW("failed to compress a cache block: " << ZSTD_getErrorName(n));
+      return n;
+    }
+#endif
+    default:
+      THROW("unsupported cache codec " << (int)codec);
+  }
+}
+
+void unpack_bytes(unsigned char codec, const char* src, uint64_t size, char* dst, uint64_t raw)
+{ bool ok = false;
+  switch (codec)
+  { case CODEC_ZLIB:
+    { uLongf n = (uLongf)raw;
+      ok = uncompress((Bytef*)dst, &n, (const Bytef*)src, (uLong)size) == Z_OK && n == raw;
+      break;
+    }
+#ifdef HAVE_LZ4
+    case CODEC_LZ4:
+      ok = LZ4_decompress_safe(src, dst, (int)size, (int)raw) == (int)raw;
+      break;
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD:
+      ok = ZSTD_decompress(dst, raw, src, size) == raw;
+      break;
+#endif
+    default:
+      THROW("the cache was written with codec " << (int)codec << ", which this vw was built without");
+  }
+  if (!ok)
+    THROW("corrupt compressed cache block");
+}
+
+inline uint64_t restart_count(uint64_t examples)
+{ return (examples + block_restart_interval - 1) / block_restart_interval; }
+
+// Decompress the payload of a compressed block into out, leaving out at the first example.
+void unpack_cache_block(unsigned char codec, const char* payload, uint64_t size, uint64_t examples, io_buf& out)
+{ uint64_t table = restart_count(examples) * sizeof(uint32_t);
+  uint64_t raw;
+  if (size < sizeof(raw))
+    THROW("corrupt compressed cache block");
+  memcpy(&raw, payload, sizeof(raw));
+  if (raw < table)
+    THROW("corrupt compressed cache block");
+  if ((uint64_t)(out.space.end_array - out.space.begin()) < raw)
+    out.space.resize(raw);
+  unpack_bytes(codec, payload + sizeof(raw), size - sizeof(raw), out.space.begin(), raw);
+  out.space.end() = out.space.begin() + raw;
+  out.head = out.space.begin() + table;
+}
+
+struct block_reader
+{ uint64_t examples;     // examples in the current block
+  uint64_t next;         // next example of the current block to read
+  uint32_t* restarts;    // only valid for blocks read whole, see next_cache_block
+  char* records;
+  uint64_t records_size;
+  uint64_t shard_blocks; // blocks left in this shard
+  unsigned char codec;
+  io_buf unpacked;       // the current block of a compressed cache, for read_cached_features
+};
+
+// Move on to the next block of a block structured cache, skipping the end markers of all but
+// the last cache file.  Reads the whole block into the input buffer if whole, or else just its
+// restart points, leaving the input at the first example.  Compressed blocks are always read
+// whole, and are decompressed into unpacked unless whole.  Returns false at the end of the
+// input or of this shard.
+bool next_cache_block(parser& p, bool whole)
+{ block_reader& r = *p.block_in;
+  io_buf& input = *p.input;
+  while (true)
+  { if (p.cache_shards > 1 && r.shard_blocks == 0)
+      return false;
+    char* c;
+    if (buf_read(input, c, 2 * sizeof(uint64_t)) < 2 * sizeof(uint64_t))
+      return false;
+    uint64_t payload = ((uint64_t*)c)[0];
+    uint64_t examples = ((uint64_t*)c)[1];
+    if (examples == 0)
+    { if (buf_read(input, c, payload) < payload)
+        return false;
+      continue;
+    }
+
+    if (r.codec != CODEC_NONE)
+    { if (buf_read(input, c, payload) < payload)
+        return false;
+      if (whole)
+      { r.records = c;
+        r.records_size = payload;
+      }
+      else
+        unpack_cache_block(r.codec, c, payload, examples, r.unpacked);
+    }
+    else
+    { uint64_t table = restart_count(examples) * sizeof(uint32_t);
+      uint64_t wanted = whole ? payload : table;
+      if (payload < table || buf_read(input, c, wanted) < wanted)
+        return false;
+      r.restarts = (uint32_t*)c;
+      r.records = c + table;
+      r.records_size = payload - table;
+    }
+    r.examples = examples;
+    r.next = 0;
+    if (p.cache_shards > 1)
+      r.shard_blocks--;
+    return true;
+  }
+}
+
+int read_cached_features(vw* all, v_array<example*>& examples)
+{ parser& p = *all->p;
+  if (p.block_cache && p.block_in->next == p.block_in->examples && !next_cache_block(p, false))
+    return 0;
+
+  io_buf& input = p.block_cache && p.block_in->codec != CODEC_NONE ? p.block_in->unpacked : *p.input;
+  int total = read_cached_example(all, all->sd, input, examples[0]);
+  if (p.block_cache && total > 0)
+    p.block_in->next++;
+  return total;
+}
+
+// Copy the next run of examples of a block structured cache into records, for decoding elsewhere.
+// Runs start at restart points and hold about max(chunk, block_restart_interval) examples.
+// Returns the number of examples to decode, at most max_examples.  A compressed block is copied
+// whole, as its example count and payload, for unpack_cache_records.
+uint64_t read_cache_records(parser& p, io_buf& records, size_t chunk, size_t max_examples)
+{ block_reader& r = *p.block_in;
+  if (r.next == r.examples && !next_cache_block(p, true))
+    return 0;
+
+  if (r.codec != CODEC_NONE)
+  { uint64_t size = sizeof(r.examples) + r.records_size;
+    if ((uint64_t)(records.space.end_array - records.space.begin()) < size)
+      records.space.resize(size);
+    memcpy(records.space.begin(), &r.examples, sizeof(r.examples));
+    memcpy(records.space.begin() + sizeof(r.examples), r.records, r.records_size);
+    records.space.end() = records.space.begin() + size;
+    records.head = records.space.begin();
+    r.next = r.examples;
+    return min(r.examples, (uint64_t)max_examples);
+  }
+
+  uint64_t first = r.next;
+  uint64_t run = max(chunk / block_restart_interval, (size_t)1) * block_restart_interval;
+  uint64_t last = min(first + run, r.examples);
+  uint64_t begin = r.restarts[first / block_restart_interval];
+  uint64_t end = last == r.examples ? r.records_size : r.restarts[last / block_restart_interval];
+  if (begin > end || end > r.records_size)
+    THROW("corrupt restart points in cache block");
+  r.next = last;
+
+  if ((uint64_t)(records.space.end_array - records.space.begin()) < end - begin)
+    records.space.resize(end - begin);
+  memcpy(records.space.begin(), r.records + begin, end - begin);
+  records.space.end() = records.space.begin() + (end - begin);
+  records.head = records.space.begin();
+  return min(last - first, (uint64_t)max_examples);
+}
+
+unsigned char block_cache_codec(parser& p)
+{ return p.block_in->codec; }
+
+// Returns the buffer to decode the records copied by read_cache_records from, which is unpacked
+// holding the decompressed block for a compressed cache.
+io_buf& unpack_cache_records(unsigned char codec, io_buf& records, io_buf& unpacked)
+{ if (codec == CODEC_NONE)
+    return records;
+  uint64_t examples;
+  memcpy(&examples, records.space.begin(), sizeof(examples));
+  unpack_cache_block(codec, records.space.begin() + sizeof(examples),
+                     records.space.end() - records.space.begin() - sizeof(examples), examples, unpacked);
+  return unpacked;
+}
+
+// Start reading the cache file f, just past its header, of which it reads the codec.  With --cache_shards, the index at the
+// end of the file gives the offset of the first block of this shard.
+void reset_block_cache(parser& p, int f)
+{ if (!p.block_cache)
+    return;
+  if (p.block_in == nullptr)
+    p.block_in = new block_reader;
+  block_reader& r = *p.block_in;
+  r.examples = 0;
+  r.next = 0;
+  r.shard_blocks = 0;
+  unsigned char codec;
+  if (p.input->read_file(f, &codec, 1) < 1)
+    THROW("block cache header is truncated");
+  if (f != p.input->files[0] && codec != r.codec)
+    THROW("cache files mix block codecs");
+  r.codec = codec;
+  if (p.cache_shards <= 1)
+    return;
+
+  io_buf& input = *p.input;
+  if (input.compressed())
+    THROW("--cache_shards needs an uncompressed cache file");
+
+  uint64_t trailer[2];
+  if (file_seek(f, -(int64_t)sizeof(trailer), SEEK_END) < 0
+      || input.read_file(f, trailer, sizeof(trailer)) != (ssize_t)sizeof(trailer) || trailer[1] != block_cache_magic)
+    THROW("block cache has no index, it was probably not written completely");
+
+  uint64_t blocks = trailer[0];
+  uint64_t first = blocks * p.cache_shard / p.cache_shards;
+  uint64_t last = blocks * (p.cache_shard + 1) / p.cache_shards;
+  r.shard_blocks = last - first;
+  if (first < last)
+  { uint64_t entry[2];
+    if (file_seek(f, -(int64_t)(sizeof(trailer) + (blocks - first) * sizeof(entry)), SEEK_END) < 0
+        || input.read_file(f, entry, sizeof(entry)) != (ssize_t)sizeof(entry))
+      THROW("failed to read the block cache index");
+    file_seek(f, (int64_t)entry[0], SEEK_SET);
+  }
+}
+
 inline uint64_t ZigZagEncode(int64_t n)
 { uint64_t ret = (n << 1) ^ (n >> 63);
   return ret;
@@ -191,3 +478,111 @@ void cache_features(io_buf& cache, example* ae, uint64_t mask)
   for (namespace_index ns : ae->indices)
     output_features(cache, ns, ae->feature_space[ns], mask);
 }
+
+// A cache block is assembled in memory, so running out of space grows the buffer rather than writing it out.
+class block_buf : public io_buf
+{
+public:
+  virtual void flush()
+  { space.end() = head; // resize keeps what lies before end
+    space.resize(2 * (space.end_array - space.begin()));
+    head = space.end();
+    space.end() = space.begin();
+  }
+};
+
+struct block_writer
+{ block_buf records;
+  v_array<uint32_t> restarts; // offset of every block_restart_interval-th example in records
+  uint64_t examples;          // examples in records
+  unsigned char codec;
+  v_array<char> raw;          // restart points and records of a block to compress
+  v_array<char> packed;
+  v_array<uint64_t> index;    // file offset and example count of each written block
+  uint64_t offset;            // bytes written to the cache file so far
+};
+
+void write_cache_block(parser& p, uint64_t examples, const char* table, uint64_t table_size, const char* records, uint64_t records_size)
+{ uint64_t header[2] = { table_size + records_size, examples };
+  bin_write_fixed(*p.output, (char*)header, sizeof(header));
+  bin_write_fixed(*p.output, table, table_size);
+  bin_write_fixed(*p.output, records, records_size);
+  p.block_out->offset += sizeof(header) + table_size + records_size;
+}
+
+void end_cache_block(parser& p)
+{ block_writer& w = *p.block_out;
+  if (w.examples == 0)
+    return;
+  w.index.push_back(w.offset);
+  w.index.push_back(w.examples);
+  if (w.codec == CODEC_NONE)
+    write_cache_block(p, w.examples, (char*)w.restarts.begin(), w.restarts.size() * sizeof(uint32_t),
+                      w.records.space.begin(), w.records.head - w.records.space.begin());
+  else
+  { w.raw.erase();
+    push_many(w.raw, (char*)w.restarts.begin(), w.restarts.size() * sizeof(uint32_t));
+    push_many(w.raw, w.records.space.begin(), w.records.head - w.records.space.begin());
+    uint64_t raw_size = w.raw.size();
+    uint64_t packed_size = pack_bytes(w.codec, w.raw.begin(), raw_size, w.packed);
+    write_cache_block(p, w.examples, (char*)&raw_size, sizeof(raw_size), w.packed.begin(), packed_size);
+  }
+  w.records.head = w.records.space.begin();
+  w.restarts.erase();
+  w.examples = 0;
+}
+
+void start_block_cache(parser& p, uint64_t header_size)
+{ block_writer* w = new block_writer;
+  w->restarts = v_init<uint32_t>();
+  w->examples = 0;
+  w->codec = p.cache_codec;
+  w->raw = v_init<char>();
+  w->packed = v_init<char>();
+  w->index = v_init<uint64_t>();
+  w->offset = header_size;
+  p.block_out = w;
+}
+
+void free_block_writer(parser& p)
+{ p.block_out->restarts.delete_v();
+  p.block_out->index.delete_v();
+  p.block_out->raw.delete_v();
+  p.block_out->packed.delete_v();
+  delete p.block_out;
+  p.block_out = nullptr;
+}
+
+void finish_block_cache(parser& p)
+{ end_cache_block(p);
+  v_array<uint64_t>& index = p.block_out->index;
+  uint64_t trailer[2] = { index.size() / 2, block_cache_magic };
+  push_many(index, trailer, 2);
+  write_cache_block(p, 0, nullptr, 0, (char*)index.begin(), index.size() * sizeof(uint64_t));
+  free_block_writer(p);
+}
+
+void free_block_cache(parser& p)
+{ if (p.block_out != nullptr)
+    free_block_writer(p);
+  delete p.block_in;
+  p.block_in = nullptr;
+}
+
+void cache_example(vw& all, example* ae)
+{ parser& p = *all.p;
+  block_writer* w = p.block_out;
+  if (w == nullptr)
+  { p.lp.cache_label(&ae->l, *p.output);
+    cache_features(*p.output, ae, all.parse_mask);
+    return;
+  }
+
+  if (w->examples % block_restart_interval == 0)
+    w->restarts.push_back((uint32_t)(w->records.head - w->records.space.begin()));
+  p.lp.cache_label(&ae->l, w->records);
+  cache_features(w->records, ae, all.parse_mask);
+  w->examples++;
+  if ((size_t)(w->records.head - w->records.space.begin()) >= p.cache_block_size)
+    end_cache_block(p);
+}
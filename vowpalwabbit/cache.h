@@ -8,10 +8,46 @@ license as described in the file LICENSE.
 #include "io_buf.h"
 #include "example.h"
 
+struct parser;
+struct shared_data;
+
 char* run_len_decode(char *p, size_t& i);
 char* run_len_encode(char *p, size_t i);
 
+/* A cache starts with the version string, a format byte and the number of bits it was
+** written with (see make_write_cache).  Format 'c' is a single stream of examples, each a
+** cached label, tag and run length encoded feature groups.  Format 'b' groups the same example
+** records into blocks that can be decoded independently:
+**
+**   block:    uint64 payload bytes, uint64 examples, payload
+**   payload:  uint32 restart point for every block_restart_interval examples, example records
+**   end:      uint64 index bytes, uint64 0, index
+**   index:    uint64 offset, uint64 examples for every block, uint64 blocks, uint64 block_cache_magic
+**
+** Restart points are offsets into the records, so a block can also be decoded in pieces.
+** The index ends the file, so a reader can find any block range from the last 16 bytes.
+**
+** A 'b' header carries one more byte after the number of bits, the codec of the blocks.  With a
+** codec other than none, a payload is instead a uint64 uncompressed size followed by the
+** compressed restart points and records, and a block is always decoded whole.
+*/
+const uint64_t block_cache_magic = 0x736b636f6c627776; // "vwblocks"
+const uint64_t block_restart_interval = 64;
+
+enum cache_codec { CODEC_NONE = 0, CODEC_ZLIB = 1, CODEC_LZ4 = 2, CODEC_ZSTD = 3 };
+unsigned char cache_codec_id(std::string name); // throws for unknown codecs or ones vw was built without
+
 int read_cached_features(vw* all, v_array<example*>& examples);
+int read_cached_example(vw* all, shared_data* sd, io_buf& input, example* ae);
+void cache_example(vw& all, example* ae);
+
+void start_block_cache(parser& p, uint64_t header_size);
+void finish_block_cache(parser& p);
+void reset_block_cache(parser& p, int f);
+uint64_t read_cache_records(parser& p, io_buf& records, size_t chunk, size_t max_examples);
+unsigned char block_cache_codec(parser& p);
+io_buf& unpack_cache_records(unsigned char codec, io_buf& records, io_buf& unpacked);
+void free_block_cache(parser& p);
 void cache_tag(io_buf& cache, v_array<char> tag);
 void cache_features(io_buf& cache, example* ae, uint64_t mask);
 void output_byte(io_buf& cache, unsigned char s);
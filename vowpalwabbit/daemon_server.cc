@@ -0,0 +1,794 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <unordered_set>
+#include <sstream>
+#endif
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "daemon_server.h"
+#include "parse_example.h"
+#include "unique_sort.h"
+#include "best_constant.h"
+#include "learner.h"
+#include "model_snapshot.h"
+#include "vw.h"
+
+using namespace std;
+
+#ifdef __linux__
+using namespace std::chrono;
+
+const size_t read_size = 1 << 16;
+const size_t max_pending_output = 1 << 20; // stop reading from a client until it takes its predictions
+const int max_events = 64;
+const size_t latency_buckets = 32;        // powers of two of microseconds
+const size_t max_queued = 1 << 14;        // examples waiting for the trainer before I/O threads wait too
+
+struct connection
+{ int fd;
+  v_array<char> in;  // received bytes not yet served, a partial line at most
+  v_array<char> out; // predictions not yet sent
+  size_t sent;       // bytes at the front of out already sent
+  size_t batched;    // examples in the batch of the thread serving the connection
+  bool reading;      // the serving thread is receiving from the connection
+  bool eof;          // the client has finished sending, close once out is sent
+  bool failed;       // close once the batch is done with the connection
+};
+
+struct batch_stats
+{ size_t batches;
+  size_t examples;
+  double latency;              // microseconds from the first example of a batch to its answers
+  double max_latency;
+  size_t histogram[latency_buckets];
+};
+
+// With --snapshot_every the I/O threads predict from snapshots of the model and queue the
+// examples to learn from for one trainer thread, which alone updates all.weights.  It publishes
+// a snapshot every snapshot_every examples, and whenever it has caught up with the queue.
+struct trainer
+{ mutex lock;
+  condition_variable queued;  // examples were queued, or the server stops
+  condition_variable drained; // the queue has room again
+  v_array<example*> queue;
+  v_array<example*> spare;    // emptied examples for the I/O threads to reuse
+  bool stop;                  // set once the I/O threads are done, or when learning failed
+  size_t learned;
+};
+
+// Connections are registered with EPOLLONESHOT, so a connection is served by one thread at a
+// time and its predictions go back in the order of its examples.  A connection is armed again
+// only once the batch holding its examples has been answered.
+struct io_server
+{ vw* all;
+  int epoll_fd;
+  int listen_fd;
+  int stop_fd;       // an eventfd, readable once the server stops
+  mutex account;     // held while positioning and accounting examples, and while saving the model
+  batch_stats stats; // under account
+  mutex connections_lock;
+  unordered_set<connection*> connections;
+  snapshot_store* snapshots; // with --snapshot_every, else nullptr
+  trainer learning;
+};
+
+// An I/O thread collects the examples of the connections it serves into a batch, which is
+// predicted back to back once it holds --io_batch_size examples or its first example has
+// waited --io_batch_wait microseconds.
+struct io_worker
+{ size_t index;                  // of the thread, which pins snapshots under it
+  parser* p;                     // scratch space for tokenizing, label parsing and ngrams
+  v_array<example*> pool;        // examples of the batch, reused from batch to batch
+  v_array<connection*> owners;   // the connection of each example of the batch
+  size_t used;                   // examples of pool in the batch
+  v_array<connection*> waiting;  // connections with examples in the batch, to answer and arm
+  v_array<char> answers;         // the predictions of the batch
+  v_array<size_t> ends;          // where the answer to each example of the batch ends in answers
+  steady_clock::time_point first; // when the first example of the batch was parsed
+  shared_data sd;                // label statistics seen while parsing the batch
+};
+
+void watch(io_server& server, int op, int fd, uint32_t events, void* ptr)
+{ epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = ptr;
+  if (epoll_ctl(server.epoll_fd, op, fd, &ev) < 0)
+    THROWERRNO("epoll_ctl");
+}
+
+// Waits at most timeout microseconds for events, or indefinitely when timeout is negative.
+int wait_for_events(io_server& server, epoll_event* events, long timeout)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+  if (timeout >= 0)
+  { timespec t = { timeout / 1000000, (timeout % 1000000) * 1000 };
+    int n = epoll_pwait2(server.epoll_fd, events, max_events, &t, nullptr);
+    if (n >= 0 || errno != ENOSYS)
+      return n;
+  }
+#endif
+  return epoll_wait(server.epoll_fd, events, max_events, timeout < 0 ? -1 : (int)((timeout + 999) / 1000));
+}
+
+long waited(io_worker& w)
+{ return (long)duration_cast<microseconds>(steady_clock::now() - w.first).count();
+}
+
+void append_prediction(v_array<char>& out, float res, v_array<char>& tag)
+{ char temp[64];
+  int len;
+  if (floorf(res) != res)
+    len = snprintf(temp, sizeof(temp), "%f", res);
+  else
+    len = snprintf(temp, sizeof(temp), "%.0f", res);
+  push_many(out, temp, (size_t)len);
+  if (tag.size() > 0)
+  { out.push_back(' ');
+    push_many(out, tag.begin(), tag.size());
+  }
+  out.push_back('\n');
+}
+
+// Sends the predictions still queued for c followed by text in one vectored write, and queues
+// whatever the socket does not take.  Returns false when the connection failed.
+bool send_answers(connection& c, char* text, size_t len)
+{ iovec iov[2];
+  iov[0].iov_base = c.out.begin() + c.sent;
+  iov[0].iov_len = c.out.size() - c.sent;
+  iov[1].iov_base = text;
+  iov[1].iov_len = len;
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  ssize_t put;
+  do
+    put = sendmsg(c.fd, &msg, MSG_NOSIGNAL);
+  while (put < 0 && errno == EINTR);
+  if (put < 0)
+  { if (errno != EAGAIN && errno != EWOULDBLOCK)
+      return false;
+    put = 0;
+  }
+
+  size_t queued = c.out.size() - c.sent;
+  if ((size_t)put < queued)
+  { c.sent += put;
+    push_many(c.out, text, len);
+  }
+  else
+  { size_t taken = put - queued;
+    c.out.erase();
+    c.sent = 0;
+    push_many(c.out, text + taken, len - taken);
+  }
+  return true;
+}
+
+void record_batch(batch_stats& stats, size_t examples, double latency)
+{ stats.batches++;
+  stats.examples += examples;
+  stats.latency += latency;
+  stats.max_latency = max(stats.max_latency, latency);
+  size_t bucket = 0;
+  while (bucket + 1 < latency_buckets && latency >= (double)((size_t)1 << bucket))
+    bucket++;
+  stats.histogram[bucket]++;
+}
+
+// the bound in microseconds below which at least fraction of the batches were answered
+size_t latency_bound(batch_stats& stats, double fraction)
+{ size_t seen = 0;
+  for (size_t bucket = 0; bucket < latency_buckets; bucket++)
+  { seen += stats.histogram[bucket];
+    if (seen >= fraction * stats.batches)
+      return (size_t)1 << bucket;
+  }
+  return (size_t)1 << (latency_buckets - 1);
+}
+
+void close_connection(io_server& server, connection* c)
+{ { lock_guard<mutex> l(server.connections_lock);
+    server.connections.erase(c);
+  }
+  close(c->fd);
+  c->in.delete_v();
+  c->out.delete_v();
+  delete c;
+}
+
+// Closes c or arms it for what it waits on next.
+void release(io_server& server, connection& c)
+{ bool pending = c.sent < c.out.size();
+  if (c.failed || (c.eof && !pending))
+  { close_connection(server, &c);
+    return;
+  }
+  uint32_t events = EPOLLONESHOT;
+  if (!c.eof && c.out.size() - c.sent < max_pending_output)
+    events |= EPOLLIN;
+  if (pending)
+    events |= EPOLLOUT;
+  watch(server, EPOLL_CTL_MOD, c.fd, events, &c);
+}
+
+// 'load_<file> asks a server predicting from snapshots to reload its model from file
+bool is_load_command(example& ec)
+{ return ec.tag.size() >= 6 && !strncmp((const char*)ec.tag.begin(), "load_", 5);
+}
+
+// a save or load command rather than an example to answer
+bool is_command(example& ec)
+{ return ec.indices.size() <= 1 && (LEARNER::is_save_command(&ec) || is_load_command(ec));
+}
+
+// Publishes what the trainer learned, with the label statistics as of now.
+void publish(io_server& server)
+{ vw& all = *server.all;
+  shared_data sd;
+  { lock_guard<mutex> accounting(server.account);
+    memcpy(&sd, all.sd, sizeof(shared_data));
+  }
+  publish_snapshot(all, sd, *server.snapshots, server.learning.learned);
+}
+
+// whether the trainer learns from ec, or carries out the command in it
+bool for_trainer(vw& all, example& ec)
+{ if (is_command(ec))
+    return true;
+  return !ec.test_only && all.training && ec.l.simple.label != FLT_MAX && ec.weight > 0;
+}
+
+// Hands the examples of the batch the trainer needs over to it, replacing them in the pool.
+void queue_for_trainer(io_server& server, io_worker& w)
+{ vw& all = *server.all;
+  trainer& t = server.learning;
+  unique_lock<mutex> l(t.lock);
+  while (t.queue.size() >= max_queued && !t.stop)
+    t.drained.wait(l);
+  bool queued = false;
+  for (size_t i = 0; i < w.used; i++)
+  { example*& ec = w.pool[i];
+    if (!for_trainer(all, *ec))
+      continue;
+    if (t.stop)
+    { VW::empty_example(all, *ec);
+      continue;
+    }
+    t.queue.push_back(ec);
+    ec = t.spare.empty() ? VW::alloc_examples(0, 1) : t.spare.pop();
+    queued = true;
+  }
+  if (queued)
+    t.queued.notify_one();
+}
+
+// why the model loaded can not replace the one served, or "" if it can
+string incompatible(vw& all, vw& loaded)
+{ stringstream why;
+  if (loaded.num_bits != all.num_bits)
+    why << "it has " << loaded.num_bits << " bits rather than " << all.num_bits;
+  else if (loaded.weights.sparse || loaded.weights.dense_weights.stride_shift() != all.weights.dense_weights.stride_shift())
+    why << "its learner keeps " << (1 << loaded.weights.stride_shift()) << " weights per feature rather than "
+        << (1 << all.weights.stride_shift());
+  else if (loaded.file_options->str() != all.file_options->str())
+    why << "its options '" << loaded.file_options->str() << "' differ from '" << all.file_options->str() << "'";
+  return why.str();
+}
+
+// Loads the model in file on the trainer thread while the I/O threads keep answering from the
+// current snapshot.  Once loaded it replaces all.weights, and the snapshot taken of it answers
+// every example batched from then on.  Training goes on from the state saved with the model
+// (t and the normalizer of --normalized), as if the server had started with -i file; the
+// progress counters reported stay the server's own.
+void reload_model(io_server& server, string file)
+{ vw& all = *server.all;
+  steady_clock::time_point start = steady_clock::now();
+  vw* loaded = nullptr;
+  string why;
+  try
+  { char* args[] = { (char*)"vw", (char*)"-t", (char*)"--quiet", (char*)"-i", (char*)file.c_str() };
+    loaded = VW::initialize(5, args);
+    why = incompatible(all, *loaded);
+  }
+  catch (exception& e)
+  { why = e.what();
+  }
+  if (!why.empty())
+  { cerr << "vw: not reloading " << file << ": " << why << endl;
+    if (loaded != nullptr)
+      VW::finish(*loaded);
+    return;
+  }
+
+  dense_parameters& weights = all.weights.dense_weights;
+  memcpy(weights.first(), loaded->weights.dense_weights.first(), (weights.mask() + 1) * sizeof(weight));
+  { lock_guard<mutex> accounting(server.account);
+    all.sd->t = loaded->sd->t;
+    all.sd->min_label = loaded->sd->min_label;
+    all.sd->max_label = loaded->sd->max_label;
+    all.sd->gravity = 0.;
+    all.sd->contraction = 1.;
+    all.initial_t = loaded->initial_t;
+    all.normalized_sum_norm_x = loaded->normalized_sum_norm_x;
+    all.total_weight = loaded->total_weight;
+  }
+  VW::finish(*loaded);
+  publish(server);
+  if (!all.quiet)
+    all.trace_message << "reloaded " << file << " in "
+                      << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms" << endl;
+}
+
+// Learns from the queued examples in the order they were queued in.
+void train(io_server* server)
+{ vw& all = *server->all;
+  trainer& t = server->learning;
+  v_array<example*> taken = v_init<example*>();
+  size_t unpublished = 0;
+  try
+  { unique_lock<mutex> l(t.lock);
+    while (true)
+    { while (t.queue.empty() && !t.stop)
+        t.queued.wait(l);
+      if (t.queue.empty())
+        break;
+      swap(taken, t.queue);
+      t.drained.notify_all();
+      l.unlock();
+
+      for (example* ec : taken)
+      { if (ec->indices.size() <= 1 && LEARNER::is_save_command(ec))
+        { lock_guard<mutex> accounting(server->account);
+          LEARNER::save_state(all, ec);
+        }
+        else if (is_command(*ec))
+          reload_model(*server, string(ec->tag.begin() + 5, ec->tag.size() - 5));
+        else
+        { all.l->learn(*ec);
+          t.learned++;
+          if (++unpublished >= all.snapshot_every)
+          { publish(*server);
+            unpublished = 0;
+          }
+        }
+        VW::empty_example(all, *ec);
+      }
+
+      l.lock();
+      for (example* ec : taken)
+        t.spare.push_back(ec);
+      taken.erase();
+      if (t.queue.empty() && unpublished > 0)
+      { l.unlock();
+        publish(*server);
+        unpublished = 0;
+        l.lock();
+      }
+    }
+  }
+  catch (exception& e)
+  { // stop the server, serve_connections waits for the signal
+    cerr << "vw: " << e.what() << endl;
+    kill(getpid(), SIGTERM);
+    lock_guard<mutex> l(t.lock);
+    t.stop = true;
+    t.drained.notify_all();
+    for (example* ec : taken)
+    { VW::empty_example(all, *ec);
+      t.spare.push_back(ec);
+    }
+  }
+  taken.delete_v();
+}
+
+// Predicts or learns from the examples of the batch in order, or with snapshots predicts from
+// the current one and leaves the learning to the trainer.  Accounts for the examples under one
+// lock, answers each connection with one write and arms the connections that are not being
+// read from.
+void flush_batch(io_server& server, io_worker& w)
+{ vw& all = *server.all;
+  if (server.snapshots != nullptr)
+  { model_snapshot& snapshot = pin_snapshot(*server.snapshots, w.index);
+    for (size_t i = 0; i < w.used; i++)
+      if (!is_command(*w.pool[i]))
+        snapshot_predict(all, snapshot, *w.pool[i]);
+    unpin_snapshot(*server.snapshots, w.index);
+  }
+  else
+    for (size_t i = 0; i < w.used; i++)
+    { example& ec = *w.pool[i];
+      if (ec.indices.size() <= 1 && LEARNER::is_save_command(&ec))
+      { lock_guard<mutex> accounting(server.account);
+        LEARNER::save_state(all, &ec);
+      }
+      else if (is_command(ec))
+        cerr << "vw: reloading a model needs --snapshot_every" << endl;
+      else if (ec.test_only || !all.training)
+        all.l->predict(ec);
+      else
+        all.l->learn(ec);
+    }
+
+  w.answers.erase();
+  w.ends.erase();
+  { lock_guard<mutex> accounting(server.account);
+    if (w.sd.is_more_than_two_labels_observed)
+      all.sd->is_more_than_two_labels_observed = true;
+    if (w.sd.first_observed_label != FLT_MAX)
+      count_label(all.sd, w.sd.first_observed_label);
+    if (w.sd.second_observed_label != FLT_MAX)
+      count_label(all.sd, w.sd.second_observed_label);
+    for (size_t i = 0; i < w.used; i++)
+    { example& ec = *w.pool[i];
+      if (!is_command(ec))
+      { account_example(all, ec);
+        print_update(all, ec);
+        append_prediction(w.answers, ec.pred.scalar, ec.tag);
+      }
+      w.ends.push_back(w.answers.size());
+    }
+  }
+  w.sd.is_more_than_two_labels_observed = false;
+  w.sd.first_observed_label = FLT_MAX;
+  w.sd.second_observed_label = FLT_MAX;
+
+  // the examples of a connection are consecutive in the batch
+  size_t begin = 0;
+  for (size_t i = 0; i < w.used; i++)
+  { connection& c = *w.owners[i];
+    if (i + 1 == w.used || w.owners[i + 1] != &c)
+    { size_t end = w.ends[i];
+      if (!c.failed && !send_answers(c, w.answers.begin() + begin, end - begin))
+        c.failed = true;
+      begin = end;
+    }
+    if (server.snapshots == nullptr || !for_trainer(all, *w.pool[i]))
+      VW::empty_example(all, *w.pool[i]);
+  }
+  if (server.snapshots != nullptr)
+    queue_for_trainer(server, w);
+
+  { lock_guard<mutex> accounting(server.account);
+    record_batch(server.stats, w.used, (double)waited(w));
+  }
+  w.used = 0;
+
+  for (connection* c : w.waiting)
+  { c->batched = 0;
+    if (!c->reading)
+      release(server, *c);
+  }
+  w.waiting.erase();
+}
+
+void batch_example(io_server& server, io_worker& w, connection& c, char* begin, char* end)
+{ vw& all = *server.all;
+  if (w.used == w.pool.size())
+    w.pool.push_back(VW::alloc_examples(0, 1));
+  example& ec = *w.pool[w.used];
+  substring line = { begin, end };
+  try
+  { substring_to_example(&all, w.p, &w.sd, &ec, line);
+  }
+  catch (...)
+  { VW::empty_example(all, ec);
+    throw;
+  }
+  if (all.p->sort_features && ec.sorted == false)
+    unique_sort_features(all.parse_mask, &ec);
+  { lock_guard<mutex> accounting(server.account);
+    setup_example_position(all, &ec);
+    all.p->end_parsed_examples++;
+  }
+  setup_example_features(all, *w.p, &ec);
+
+  if (w.used == 0)
+    w.first = steady_clock::now();
+  if (c.batched++ == 0)
+    w.waiting.push_back(&c);
+  if (w.used == w.owners.size())
+    w.owners.push_back(&c);
+  else
+    w.owners[w.used] = &c;
+  w.used++;
+  if (w.used >= server.all->io_batch_size)
+    flush_batch(server, w);
+}
+
+// Batches the complete lines received, and after the end of input the partial one as well.
+void batch_lines(io_server& server, io_worker& w, connection& c)
+{ char* line = c.in.begin();
+  char* end = c.in.end();
+  try
+  { for (char* newline; (newline = (char*)memchr(line, '\n', end - line)) != nullptr; line = newline + 1)
+      batch_example(server, w, c, line, newline);
+    if (c.eof && line < end)
+    { batch_example(server, w, c, line, end);
+      line = end;
+    }
+  }
+  catch (...)
+  { c.in.erase();
+    throw;
+  }
+  size_t rest = end - line;
+  memmove(c.in.begin(), line, rest);
+  c.in.end() = c.in.begin() + rest;
+}
+
+// Returns false when the connection failed.
+bool receive(io_server& server, io_worker& w, connection& c)
+{ while (!c.eof && c.out.size() - c.sent < max_pending_output)
+  { if ((size_t)(c.in.end_array - c.in.end()) < read_size)
+      c.in.resize(c.in.size() + read_size);
+    ssize_t got = recv(c.fd, c.in.end(), read_size, 0);
+    if (got < 0)
+    { if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (got == 0)
+      c.eof = true;
+    c.in.end() += got;
+    batch_lines(server, w, c);
+  }
+  return true;
+}
+
+void serve_connection(io_server& server, io_worker& w, connection& c)
+{ c.reading = true;
+  bool ok;
+  try
+  { ok = receive(server, w, c) && (c.sent == c.out.size() || send_answers(c, nullptr, 0));
+  }
+  catch (exception& e)
+  { cerr << "vw: closing a connection: " << e.what() << endl;
+    ok = false;
+  }
+  c.reading = false;
+  if (!ok)
+    c.failed = true;
+  if (c.batched == 0)
+    release(server, c);
+}
+
+void accept_connections(io_server& server)
+{ while (true)
+  { int fd = accept4(server.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    { if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        cerr << "accept: " << strerror(errno) << endl;
+      break;
+    }
+    int on = 1; // predictions are small and a client usually waits for each
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&on, sizeof(on));
+
+    connection* c = new connection;
+    c->fd = fd;
+    c->in = v_init<char>();
+    c->out = v_init<char>();
+    c->sent = 0;
+    c->batched = 0;
+    c->reading = false;
+    c->eof = false;
+    c->failed = false;
+    { lock_guard<mutex> l(server.connections_lock);
+      server.connections.insert(c);
+    }
+    watch(server, EPOLL_CTL_ADD, fd, EPOLLIN | EPOLLONESHOT, c);
+  }
+  watch(server, EPOLL_CTL_MOD, server.listen_fd, EPOLLIN | EPOLLONESHOT, &server.listen_fd);
+}
+
+void io_thread(io_server* server, size_t index)
+{ vw& all = *server->all;
+  io_worker w;
+  w.index = index;
+  w.p = &calloc_or_throw<parser>();
+  w.p->hasher = all.p->hasher;
+  w.p->lp = all.p->lp;
+  w.pool = v_init<example*>();
+  w.owners = v_init<connection*>();
+  w.used = 0;
+  w.waiting = v_init<connection*>();
+  w.answers = v_init<char>();
+  w.ends = v_init<size_t>();
+  memcpy(&w.sd, all.sd, sizeof(shared_data));
+  w.sd.is_more_than_two_labels_observed = false;
+  w.sd.first_observed_label = FLT_MAX;
+  w.sd.second_observed_label = FLT_MAX;
+
+  try
+  { epoll_event events[max_events];
+    bool stop = false;
+    while (!stop)
+    { long timeout = -1;
+      if (w.used > 0)
+        timeout = max(0L, (long)all.io_batch_wait - waited(w));
+      int n = wait_for_events(*server, events, timeout);
+      if (n < 0)
+      { if (errno == EINTR)
+          continue;
+        THROWERRNO("epoll_wait");
+      }
+      for (int i = 0; i < n; i++)
+        if (events[i].data.ptr == &server->stop_fd)
+          stop = true;
+        else if (events[i].data.ptr == &server->listen_fd)
+          accept_connections(*server);
+        else
+          serve_connection(*server, w, *(connection*)events[i].data.ptr);
+      if (w.used > 0 && (stop || waited(w) >= (long)all.io_batch_wait))
+        flush_batch(*server, w);
+    }
+  }
+  catch (exception& e)
+  { // stop the server, serve_connections waits for the signal
+    cerr << "vw: " << e.what() << endl;
+    kill(getpid(), SIGTERM);
+  }
+
+  for (example* ec : w.pool)
+  { VW::dealloc_example(all.p->lp.delete_label, *ec);
+    free(ec);
+  }
+  w.pool.delete_v();
+  w.owners.delete_v();
+  w.waiting.delete_v();
+  w.answers.delete_v();
+  w.ends.delete_v();
+  w.p->words.delete_v();
+  w.p->channels.delete_v();
+  w.p->name.delete_v();
+  w.p->parse_name.delete_v();
+  w.p->gram_mask.delete_v();
+  free(w.p);
+}
+
+// SIGHUP reloads the model the server started with, as 'load_<file> would.
+void request_reload(io_server& server)
+{ vw& all = *server.all;
+  if (server.snapshots == nullptr)
+  { cerr << "vw: reloading a model needs --snapshot_every" << endl;
+    return;
+  }
+  if (!all.vm.count("initial_regressor"))
+  { cerr << "vw: no model to reload, the server did not start with one" << endl;
+    return;
+  }
+  string command = "load_" + all.vm["initial_regressor"].as< vector<string> >()[0];
+  trainer& t = server.learning;
+  lock_guard<mutex> l(t.lock);
+  if (t.stop)
+    return;
+  example* ec = t.spare.empty() ? VW::alloc_examples(0, 1) : t.spare.pop();
+  push_many(ec->tag, command.c_str(), command.size());
+  t.queue.push_back(ec);
+  t.queued.notify_one();
+}
+
+void serve_connections(vw& all)
+{ io_server server;
+  server.all = &all;
+  memset(&server.stats, 0, sizeof(server.stats));
+  server.snapshots = nullptr;
+  server.learning.queue = v_init<example*>();
+  server.learning.spare = v_init<example*>();
+  server.learning.stop = false;
+  server.learning.learned = 0;
+  server.listen_fd = all.p->bound_sock;
+  fcntl(server.listen_fd, F_SETFL, fcntl(server.listen_fd, F_GETFL) | O_NONBLOCK);
+  server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (server.epoll_fd < 0)
+    THROWERRNO("epoll_create1");
+  server.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (server.stop_fd < 0)
+    THROWERRNO("eventfd");
+  watch(server, EPOLL_CTL_ADD, server.listen_fd, EPOLLIN | EPOLLONESHOT, &server.listen_fd);
+  watch(server, EPOLL_CTL_ADD, server.stop_fd, EPOLLIN, &server.stop_fd);
+
+  // the stop and reload signals are taken here with sigwait, so they are blocked before the
+  // I/O threads start and inherit the mask
+  sigset_t control_signals, old_mask;
+  sigemptyset(&control_signals);
+  sigaddset(&control_signals, SIGTERM);
+  sigaddset(&control_signals, SIGINT);
+  sigaddset(&control_signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &control_signals, &old_mask);
+
+  if (!all.quiet)
+    all.trace_message << "serving connections on " << all.io_threads << " threads, in batches of up to "
+                      << all.io_batch_size << " examples waiting up to " << all.io_batch_wait << " us" << endl;
+  thread trainer_thread;
+  if (all.snapshot_every > 0)
+  { server.snapshots = create_snapshots(all.io_threads);
+    publish(server);
+    trainer_thread = thread(train, &server);
+    if (!all.quiet)
+      all.trace_message << "learning on a thread of its own, predicting from a snapshot refreshed every "
+                        << all.snapshot_every << " examples" << endl;
+  }
+  vector<thread> threads;
+  for (size_t i = 0; i < all.io_threads; i++)
+    threads.push_back(thread(io_thread, &server, i));
+
+  int signal;
+  while (sigwait(&control_signals, &signal) == 0 && signal == SIGHUP)
+    request_reload(server);
+  uint64_t one = 1;
+  if (write(server.stop_fd, &one, sizeof(one)) != sizeof(one))
+    cerr << "vw: failed to stop the I/O threads: " << strerror(errno) << endl;
+  for (thread& t : threads)
+    t.join();
+  if (server.snapshots != nullptr)
+  { { lock_guard<mutex> l(server.learning.lock);
+      server.learning.stop = true;
+    }
+    server.learning.queued.notify_one();
+    trainer_thread.join();
+  }
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+  for (connection* c : server.connections)
+  { close(c->fd);
+    c->in.delete_v();
+    c->out.delete_v();
+    delete c;
+  }
+  for (example* ec : server.learning.queue) // left over when learning failed
+    server.learning.spare.push_back(ec);
+  for (example* ec : server.learning.spare)
+  { VW::dealloc_example(all.p->lp.delete_label, *ec);
+    free(ec);
+  }
+  server.learning.queue.delete_v();
+  server.learning.spare.delete_v();
+  close(server.stop_fd);
+  close(server.epoll_fd);
+  all.l->end_examples();
+
+  batch_stats& stats = server.stats;
+  if (!all.quiet && stats.batches > 0)
+    all.trace_message << "batches = " << stats.batches
+                      << ", mean batch size = " << (double)stats.examples / stats.batches
+                      << ", batch latency mean = " << stats.latency / stats.batches << " us"
+                      << ", p50 < " << latency_bound(stats, 0.5) << " us"
+                      << ", p99 < " << latency_bound(stats, 0.99) << " us"
+                      << ", max = " << stats.max_latency << " us" << endl;
+  if (server.snapshots != nullptr)
+  { if (!all.quiet)
+      all.trace_message << "learned from " << server.learning.learned << " examples, snapshots = "
+                        << snapshots_published(*server.snapshots) << ", mean copy time = "
+                        << snapshot_copy_time(*server.snapshots) << " us" << endl;
+    destroy_snapshots(server.snapshots);
+  }
+}
+#else
+void serve_connections(vw&)
+{ THROW("--io_threads needs epoll, which is only available on Linux");
+}
+#endif
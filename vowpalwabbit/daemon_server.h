@@ -0,0 +1,17 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+
+struct vw;
+
+// --daemon --io_threads: rather than forking children that each serve one connection at a
+// time, one process accepts every connection and multiplexes them with epoll on a few threads.
+// Each connection keeps its own buffers, so a client may send any number of text examples, one
+// per line, and gets a prediction line back for each in order.  All threads share the model.
+// With --snapshot_every, a 'load_<file> line or SIGHUP (for the -i model) swaps in a new model
+// without dropping connections.  Serves until SIGTERM or SIGINT, then returns so that the
+// final model can be saved.
+void serve_connections(vw& all);
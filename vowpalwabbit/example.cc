@@ -154,6 +154,22 @@ void free_flatten_example(flat_example* fec)
   }
 }
 
+features& namespace_table::add(namespace_index i)
+{ size_t k = used++;
+  if (k % chunk == 0)
+    chunks[k / chunk] = calloc_or_throw<features>(chunk);
+  slot[i] = (uint16_t)(k + 1);
+  return group(k);
+}
+
+void namespace_table::delete_v()
+{ for (size_t k = 0; k < used; k++)
+    group(k).delete_v();
+  for (size_t c = 0; c * chunk < used; c++)
+    free(chunks[c]);
+  clear_slots();
+}
+
 namespace VW
 {
 example *alloc_examples(size_t, size_t count = 1)
@@ -181,8 +197,7 @@ void dealloc_example(void(*delete_label)(void*), example&ec, void(*delete_predic
     delete ec.passthrough;
   }
 
-  for (size_t j = 0; j < 256; j++)
-    ec.feature_space[j].delete_v();
+  ec.feature_space.delete_v();
 
   ec.indices.delete_v();
 }
@@ -52,17 +52,48 @@ typedef union
 
 typedef unsigned char namespace_index;
 
+// The feature groups of an example, only for the namespaces it has used.  A group is allocated the
+// first time its namespace is indexed and kept, with its arrays, while the example is emptied and
+// reused.  Groups are allocated 8 at a time in chunks which never move, so references to groups stay
+// valid as namespaces are added.  All zeros is an empty table, since examples are calloc'd.
+struct namespace_table
+{ static const size_t chunk = 8;
+
+  uint16_t slot[256]; // 1 + the position of each namespace's group, 0 for none yet
+  features* chunks[256 / chunk];
+  uint16_t used; // groups allocated
+
+  namespace_table() { clear_slots(); }
+  void clear_slots()
+  { memset(slot, 0, sizeof(slot));
+    memset(chunks, 0, sizeof(chunks));
+    used = 0;
+  }
+
+  inline features& operator[](namespace_index i)
+  { uint16_t s = slot[i];
+    return s != 0 ? group(s - 1) : add(i);
+  }
+
+  // every group allocated so far, in the order their namespaces were first used
+  inline size_t size() const { return used; }
+  inline features& group(size_t k) { return chunks[k / chunk][k % chunk]; }
+
+  features& add(namespace_index i);
+  void delete_v();
+};
+
 struct example // core example datatype.
 { class iterator
-  { features* _feature_space;
+  { namespace_table* _feature_space;
     namespace_index* _index;
   public:
-    iterator(features* feature_space, namespace_index* index)
+    iterator(namespace_table* feature_space, namespace_index* index)
       : _feature_space(feature_space), _index(index)
     { }
 
     features& operator*()
-    { return _feature_space[*_index];
+    { return (*_feature_space)[*_index];
     }
 
     iterator& operator++()
@@ -86,7 +117,7 @@ struct example // core example datatype.
   v_array<char> tag;//An identifier for the example.
   size_t example_counter;
   v_array<namespace_index> indices;
-  features feature_space[256]; //Groups of feature values.
+  namespace_table feature_space; //Groups of feature values, by namespace.
   uint64_t ft_offset;//An offset for all feature values.
 
   //helpers
@@ -103,8 +134,8 @@ struct example // core example datatype.
   bool sorted;//Are the features sorted or not?
   bool in_use; //in use or not (for the parser)
 
-  iterator begin() { return iterator(feature_space, indices.begin()); }
-  iterator end() { return iterator(feature_space, indices.end()); }
+  iterator begin() { return iterator(&feature_space, indices.begin()); }
+  iterator end() { return iterator(&feature_space, indices.end()); }
 };
 
 struct vw;
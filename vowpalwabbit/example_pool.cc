@@ -0,0 +1,78 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <mutex>
+#include <algorithm>
+#include "vw.h"
+#include "example_pool.h"
+
+using namespace std;
+
+const size_t first_slab = 16;     // examples
+const size_t largest_slab = 1024; // slabs double up to this
+
+struct example_slab
+{ example* first;
+  size_t count;
+};
+
+struct example_pool
+{ mutex lock; // the library may read examples on several threads
+  v_array<example_slab> slabs;
+  v_array<example*> spare; // emptied examples, the most recently returned last
+};
+
+example_pool* create_example_pool()
+{ example_pool* pool = new example_pool;
+  pool->slabs = v_init<example_slab>();
+  pool->spare = v_init<example*>();
+  return pool;
+}
+
+void destroy_example_pool(example_pool* pool, void(*delete_label)(void*), void(*delete_prediction)(void*))
+{ for (example_slab& slab : pool->slabs)
+  { for (size_t i = 0; i < slab.count; i++)
+      VW::dealloc_example(delete_label, slab.first[i], delete_prediction);
+    free(slab.first);
+  }
+  pool->slabs.delete_v();
+  pool->spare.delete_v();
+  delete pool;
+}
+
+example* pool_example(example_pool& pool)
+{ lock_guard<mutex> hold(pool.lock);
+  if (pool.spare.empty())
+  { size_t count = pool.slabs.empty() ? first_slab : min(2 * pool.slabs.last().count, largest_slab);
+    example_slab slab = { VW::alloc_examples(0, count), count };
+    pool.slabs.push_back(slab);
+    for (size_t i = count; i > 0; i--) // handed out in address order
+      pool.spare.push_back(slab.first + i - 1);
+  }
+  example* ec = pool.spare.pop();
+  ec->in_use = true;
+  return ec;
+}
+
+bool from_pool(example_pool& pool, example* ec)
+{ lock_guard<mutex> hold(pool.lock);
+  for (example_slab& slab : pool.slabs)
+    if (slab.first <= ec && ec < slab.first + slab.count)
+      return true;
+  return false;
+}
+
+void return_to_pool(example_pool& pool, example* ec)
+{ for (features& fs : *ec)
+    fs.clear();
+  ec->indices.clear();
+  ec->tag.clear();
+  ec->sorted = false;
+  ec->end_pass = false;
+  ec->in_use = false;
+
+  lock_guard<mutex> hold(pool.lock);
+  pool.spare.push_back(ec);
+}
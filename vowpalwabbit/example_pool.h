@@ -0,0 +1,23 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include "example.h"
+
+// Examples for the library readers (VW::read_example, import_example and ezexample), which
+// unlike those of the ring are never waited for.  They are allocated a slab at a time and come
+// back through VW::finish_example, which empties them without freeing the arrays their features
+// grew, so a steady stream of examples stops allocating once it has seen its largest one.
+struct example_pool;
+
+example_pool* create_example_pool();
+// frees every example of the pool, whether or not it came back
+void destroy_example_pool(example_pool* pool, void(*delete_label)(void*), void(*delete_prediction)(void*));
+
+// an empty example, allocated only when none has come back
+example* pool_example(example_pool& pool);
+bool from_pool(example_pool& pool, example* ec);
+// empties ec, keeping the capacity of its arrays, for pool_example to hand out again
+void return_to_pool(example_pool& pool, example* ec);
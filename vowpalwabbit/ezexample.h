@@ -36,10 +36,10 @@ private:
   example* get_new_example()
   { example* new_ec = VW::new_unused_example(*vw_par_ref);
     vw_par_ref->p->lp.default_label(&new_ec->l);
-    new_ec->tag.erase();
-    new_ec->indices.erase();
-    for (size_t i=0; i<256; i++)
-      new_ec->feature_space[i].erase();
+    new_ec->tag.clear();
+    new_ec->indices.clear();
+    for (size_t i=0; i<new_ec->feature_space.size(); i++)
+      new_ec->feature_space.group(i).clear();
 
     new_ec->ft_offset = 0;
     new_ec->num_features = 0;
@@ -112,10 +112,10 @@ public:
   }
 
   ~ezexample()   // calls finish_example *only* if we created our own example!
-  { if (ec->in_use && VW::is_ring_example(*vw_par_ref, ec))
+  { if (ec->in_use && VW::is_pooled_example(*vw_par_ref, ec))
       VW::finish_example(*vw_par_ref, ec);
     for (auto ecc : example_copies)
-      if (ecc->in_use && VW::is_ring_example(*vw_par_ref, ec))
+      if (ecc->in_use && VW::is_pooled_example(*vw_par_ref, ecc))
         VW::finish_example(*vw_par_ref, ecc);
     example_copies.erase();
     free(example_copies.begin());
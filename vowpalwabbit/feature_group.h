@@ -76,6 +76,9 @@ public:
     return *this;
   }
 
+  /// \return the number of features from \p rhs up to this iterator
+  ptrdiff_t operator-(const features_value_iterator& rhs) { return _begin - rhs._begin; }
+
   features_value_iterator& operator*() { return *this; }
 
   bool operator==(const features_value_iterator& rhs) { return _begin == rhs._begin; }
@@ -258,6 +261,13 @@ struct features
     space_names.erase();
   }
 
+  void clear()
+  { sum_feat_sq = 0.f;
+    values.clear();
+    indicies.clear();
+    space_names.clear();
+  }
+
   void truncate_to(const features_value_iterator& pos)
   { ssize_t i = pos._begin - values.begin();
     values.end() = pos._begin;
@@ -36,14 +36,12 @@ namespace GD
 {
 struct gd
 { //double normalized_sum_norm_x;
-  double total_weight;
   size_t no_win_counter;
   size_t early_stop_thres;
   float initial_constant;
   float neg_norm_power;
   float neg_power_t;
   float sparse_l2;
-  float update_multiplier;
   void (*predict)(gd&, base_learner&, example&);
   void (*learn)(gd&, base_learner&, example&);
   void (*update)(gd&, base_learner&, example&);
@@ -51,6 +49,12 @@ struct gd
   void (*multipredict)(gd&, base_learner&, example&, size_t, size_t, polyprediction*, bool);
   bool normalized;
   bool adaptive;
+  quantization quantize;        // of a --quantized_regressor model, which only predicts
+  quantized_weights* quantized; // its weights, read in place of all.weights
+  bool flatten;                 // --flat_features
+  bool flat_ready;              // flat holds the linear features of the example being learned
+  flat_features flat;
+  async_avg* async;             // --async_allreduce
 
   vw* all; //parallel, features, parameters
 };
@@ -95,44 +99,110 @@ static inline float InvSqrt(float x)
   return x;
 }
 
+void flatten_linear(vw& all, example& ec, flat_features& flat)
+{ size_t n = 0;
+  for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+    if (!all.ignore_linear[i.index()])
+      n += (*i).size();
+  if (n > flat.capacity)
+  { free(flat.indices);
+    flat.capacity = max(n, 2 * flat.capacity);
+    flat.indices = (feature_index*)malloc(flat.capacity * (sizeof(feature_index) + sizeof(feature_value)));
+    if (flat.indices == nullptr)
+      THROW("malloc of " << flat.capacity << " flat features failed.  out of memory?");
+    flat.values = (feature_value*)(flat.indices + flat.capacity);
+  }
+
+  flat.size = 0;
+  for (example::iterator i = ec.begin(); i != ec.end(); ++i)
+    if (!all.ignore_linear[i.index()])
+    { features& fs = *i;
+      memcpy(flat.indices + flat.size, fs.indicies.begin(), fs.size() * sizeof(feature_index));
+      memcpy(flat.values + flat.size, fs.values.begin(), fs.size() * sizeof(feature_value));
+      flat.size += fs.size();
+    }
+}
+
+void free_flat(flat_features& flat)
+{ free(flat.indices);
+  flat.indices = nullptr;
+  flat.values = nullptr;
+  flat.size = flat.capacity = 0;
+}
+
+// foreach_feature over ec, reading its linear features from g.flat while learn has filled it
+template <class R, void (*T)(R&, float, float&)>
+inline void foreach_gd_feature(gd& g, example& ec, R& dat)
+{ vw& all = *g.all;
+  if (!g.flat_ready)
+    foreach_feature<R, T>(all, ec, dat);
+  else if (all.weights.sparse)
+    foreach_feature<R, float&, T, sparse_parameters>(all, all.weights.sparse_weights, ec, g.flat, dat);
+  else
+    foreach_feature<R, float&, T, dense_parameters>(all, all.weights.dense_weights, ec, g.flat, dat);
+}
+
+// the update of train, typed by what decides how a weight is updated
+template<bool feature_mask_off, size_t spare>
+struct feature_update { float update; };
+
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
-inline void update_feature(float& update, float x, float& fw)
+inline void update_feature(feature_update<feature_mask_off, spare>& u, float x, float& fw)
 { weight* w = &fw;
   if(feature_mask_off || fw != 0.)
   { if (spare != 0)
       x *= w[spare];
-    w[0] += update * x;
+    w[0] += u.update * x;
+  }
+}
+}
+
+// without a feature mask every weight is updated, so runs of dense weights can be done in lanes
+namespace INTERACTIONS
+{
+template <size_t spare, void (*T)(GD::feature_update<true, spare>&, float, float&)>
+struct batch_T<GD::feature_update<true, spare>, float&, T, dense_parameters>
+{ static bool run(GD::feature_update<true, spare>& u, dense_parameters& weights, const feature_value* values,
+                  const feature_index* indices, size_t n, feature_value ft_value, feature_index halfhash, uint64_t offset)
+  { return dense_update(u.update, weights.first(), weights.mask(), spare, values, indices, n, ft_value, halfhash, offset);
   }
+};
 }
 
+namespace GD
+{
+
 //this deals with few nonzero features vs. all nonzero features issues.
 template<bool sqrt_rate, size_t adaptive, size_t normalized>
 float average_update(gd& g)
 { if (normalized)
   { if (sqrt_rate)
-    { float avg_norm = (float) g.total_weight / (float) g.all->normalized_sum_norm_x;
+    { float avg_norm = (float) g.all->total_weight / (float) g.all->normalized_sum_norm_x;
       if (adaptive)
         return sqrt(avg_norm);
       else
         return avg_norm;
     }
     else
-      return powf( (float) g.all->normalized_sum_norm_x / (float) g.total_weight, g.neg_norm_power);
+      return powf( (float) g.all->normalized_sum_norm_x / (float) g.all->total_weight, g.neg_norm_power);
   }
   return 1.f;
 }
 
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
-void train(gd& g, example& ec, float update)
+void train(gd& g, example& ec, float update, float update_multiplier)
 { if (normalized)
-    update *= g.update_multiplier;
-  foreach_feature<float, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(*g.all, ec, update);
+    update *= update_multiplier;
+  feature_update<feature_mask_off, spare> u = { update };
+  foreach_gd_feature<feature_update<feature_mask_off, spare>, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(g, ec, u);
 }
 
 void end_pass(gd& g)
 { vw& all = *g.all;
   sync_weights(all);
-  if (all.all_reduce != nullptr)
+  if (g.async != nullptr)
+    fold_async_avg(*g.async, all.weights);
+  else if (all.all_reduce != nullptr)
   { if (all.adaptive)
       accumulate_weighted_avg(all, all.weights);
     else
@@ -152,6 +222,13 @@ void end_pass(gd& g)
          ((all.current_pass % all.check_holdout_every_n_passes) == 0)))
       set_done(all);
   }
+
+  if (g.async != nullptr)
+  { start_async_avg(*g.async, all.weights);
+    // the last pass waits for its average, which leaves every node with the same weights
+    if (all.early_terminate || all.current_pass >= all.numpasses)
+      fold_async_avg(*g.async, all.weights);
+  }
 }
 
 #include <algorithm>
@@ -321,12 +398,6 @@ inline void vec_add_trunc(trunc_data& p, const float fx, float& fw)
 { p.prediction += trunc_weight(fw, p.gravity) * fx;
 }
 
-inline float trunc_predict(vw& all, example& ec, double gravity)
-{ trunc_data temp = {ec.l.simple.initial, (float)gravity};
-  foreach_feature<trunc_data, vec_add_trunc>(all, ec, temp);
-  return temp.prediction;
-}
-
 inline void vec_add_print(float&p, const float fx, float& fw)
 { p += fw * fx;
   cerr << " + " << fw << "*" << fx;
@@ -336,9 +407,15 @@ template<bool l1, bool audit>
 void predict(gd& g, base_learner&, example& ec)
 { vw& all = *g.all;
   if (l1)
-    ec.partial_prediction = trunc_predict(all, ec, all.sd->gravity);
+  { trunc_data temp = {ec.l.simple.initial, (float)all.sd->gravity};
+    foreach_gd_feature<trunc_data, vec_add_trunc>(g, ec, temp);
+    ec.partial_prediction = temp.prediction;
+  }
   else
-    ec.partial_prediction = inline_predict(all, ec);
+  { float temp = ec.l.simple.initial;
+    foreach_gd_feature<float, vec_add>(g, ec, temp);
+    ec.partial_prediction = temp;
+  }
 
   ec.partial_prediction *= (float)all.sd->contraction;
   ec.pred.scalar = finalize_prediction(all.sd, ec.partial_prediction);
@@ -346,6 +423,26 @@ void predict(gd& g, base_learner&, example& ec)
     print_audit_features(all, ec);
 }
 
+struct quantized_data
+{ float prediction;
+  quantized_weights* weights;
+};
+
+template<quantization kind>
+inline void vec_add_quantized(quantized_data& p, const float fx, uint64_t fi)
+{ p.prediction += fx * p.weights->get<kind>(fi);
+}
+
+// the weights were truncated and contracted when they were quantized
+template<quantization kind>
+void predict_quantized(gd& g, base_learner&, example& ec)
+{ vw& all = *g.all;
+  quantized_data temp = {ec.l.simple.initial, g.quantized};
+  foreach_feature<quantized_data, uint64_t, vec_add_quantized<kind>, quantized_weights>(all, *g.quantized, ec, temp);
+  ec.partial_prediction = temp.prediction;
+  ec.pred.scalar = finalize_prediction(all.sd, ec.partial_prediction);
+}
+
   template <class T> inline void vec_add_trunc_multipredict(multipredict_info<T>& mp, const float fx, uint64_t fi)
 {
 	size_t index = fi;
@@ -466,31 +563,37 @@ inline void pred_per_update_feature(norm_data& nd, float x, float& fw)
 
 bool global_print_features = false;
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare, bool stateless>
-float get_pred_per_update(gd& g, example& ec)
+float get_pred_per_update(gd& g, example& ec, float& update_multiplier)
 { //We must traverse the features in _precisely_ the same order as during training.
+  //The multiplier comes back through update_multiplier rather than gd, which
+  //learner threads share.
   label_data& ld = ec.l.simple;
   vw& all = *g.all;
   float grad_squared = all.loss->getSquareGrad(ec.pred.scalar, ld.label) * ec.weight;
-  if (grad_squared == 0 && !stateless) return 1.;
+  if (grad_squared == 0 && !stateless)
+  { if (normalized)
+      update_multiplier = average_update<sqrt_rate, adaptive, normalized>(g);
+    return 1.;
+  }
 
   norm_data nd = {grad_squared, 0., 0., {g.neg_power_t, g.neg_norm_power}};
-  foreach_feature<norm_data,pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless> >(all, ec, nd);
+  foreach_gd_feature<norm_data,pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless> >(g, ec, nd);
  
   if(normalized)
   { if(!stateless)
     { g.all->normalized_sum_norm_x += ec.weight * nd.norm_x;
-      g.total_weight += ec.weight;
+      g.all->total_weight += ec.weight;
     }
-    g.update_multiplier = average_update<sqrt_rate, adaptive, normalized>(g);
-    nd.pred_per_update *= g.update_multiplier;
+    update_multiplier = average_update<sqrt_rate, adaptive, normalized>(g);
+    nd.pred_per_update *= update_multiplier;
   }
   return nd.pred_per_update;
 }
 
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare, bool stateless>
-float sensitivity(gd& g, example& ec)
+float sensitivity(gd& g, example& ec, float& update_multiplier)
 { if(adaptive || normalized)
-    return get_pred_per_update<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless>(g,ec);
+    return get_pred_per_update<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless>(g, ec, update_multiplier);
   else
     return ec.total_sum_feat_sq;
 }
@@ -507,12 +610,13 @@ float get_scale(gd& g, example& ec, float weight)
 
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
 float sensitivity(gd& g, base_learner& base, example& ec)
-{ return get_scale<adaptive>(g, ec, 1.)
-         * sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, true>(g,ec);
+{ float update_multiplier = 1.f;
+  return get_scale<adaptive>(g, ec, 1.)
+         * sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, true>(g, ec, update_multiplier);
 }
 
 template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
-float compute_update(gd& g, example& ec)
+float compute_update(gd& g, example& ec, float& update_multiplier)
 { //invariant: not a test label, importance weight > 0
   label_data& ld = ec.l.simple;
   vw& all = *g.all;
@@ -520,7 +624,7 @@ float compute_update(gd& g, example& ec)
   float update = 0.;
   ec.updated_prediction = ec.pred.scalar;
   if (all.loss->getLoss(all.sd, ec.pred.scalar, ld.label) > 0.)
-  { float pred_per_update = sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(g, ec);
+  { float pred_per_update = sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(g, ec, update_multiplier);
     float update_scale = get_scale<adaptive>(g, ec, ec.weight);
     if(invariant)
       update = all.loss->getUpdate(ec.pred.scalar, ld.label, update_scale, pred_per_update);
@@ -549,8 +653,9 @@ template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off,
 void update(gd& g, base_learner&, example& ec)
 { //invariant: not a test label, importance weight > 0
   float update;
-  if ( (update = compute_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adaptive, normalized, spare> (g, ec)) != 0.)
-    train<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g, ec, update);
+  float update_multiplier = 1.f;
+  if ( (update = compute_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adaptive, normalized, spare> (g, ec, update_multiplier)) != 0.)
+    train<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g, ec, update, update_multiplier);
 
   if (g.all->sd->contraction < 1e-10)  // updating weights now to avoid numerical instability
     sync_weights(*g.all);
@@ -562,8 +667,13 @@ void learn(gd& g, base_learner& base, example& ec)
   assert(ec.in_use);
   assert(ec.l.simple.label != FLT_MAX);
   assert(ec.weight > 0.);
+  if (g.flatten)
+  { flatten_linear(*g.all, ec, g.flat);
+    g.flat_ready = true;
+  }
   g.predict(g,base,ec);
   update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g,base,ec);
+  g.flat_ready = false;
 }
 
 void sync_weights(vw& all)
@@ -788,12 +898,9 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
 	{ // restore some data to allow --save_resume work more accurate
 
 		// fix average loss
-		double total_weight = 0.; //value holder as g* may be null
-		if (!read && g != nullptr) total_weight = g->total_weight;
-		msg << "gd::total_weight " << total_weight << "\n";
-		bin_text_read_write_fixed(model_file, (char*)&total_weight, sizeof(total_weight),
+		msg << "gd::total_weight " << all.total_weight << "\n";
+		bin_text_read_write_fixed(model_file, (char*)&all.total_weight, sizeof(all.total_weight),
 			"", read, msg, text);
-		if (read && g != nullptr) g->total_weight = total_weight;
 
 		// fix "loss since last" for first printed out example details
 		msg << "sd::oec.weighted_examples " << all.sd->old_weighted_examples << "\n";
@@ -818,6 +925,8 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
 		all.sd->example_number = 0;
 		all.sd->total_features = 0;
 	}
+	if (model_file.model_weights == io_buf::MAPPED_WEIGHTS)
+		return;
 	if (all.weights.sparse)
 		save_load_online_state(all, model_file, read, text, g, msg, all.weights.sparse_weights);
 	else
@@ -836,10 +945,11 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
 
 void save_load(gd& g, io_buf& model_file, bool read, bool text)
 { vw& all = *g.all;
+  bool mapped = model_file.model_weights == io_buf::MAPPED_WEIGHTS;
   if(read)
   { initialize_regressor(all);
 
-  if (all.adaptive && all.initial_t > 0)
+  if (all.adaptive && all.initial_t > 0 && !mapped)
     {
       float init_weight = all.initial_weight;
       pair<float,float> p = make_pair(init_weight, all.initial_t);
@@ -852,12 +962,12 @@ void save_load(gd& g, io_buf& model_file, bool read, bool text)
       //feature_range*initial_t, or something like that. We could potentially fix this by just adding this base quantity times the current range to the sum of gradients
       //stored in memory at each update, and always start sum of gradients to 0, at the price of additional additions and multiplications during the update...
     }
-    if (g.initial_constant != 0.0)
+    if (g.initial_constant != 0.0 && !mapped)
       VW::set_weight(all, constant, 0, g.initial_constant);
   }
 
   if (model_file.files.size() > 0)
-  { bool resume = all.save_resume;
+  { bool resume = all.save_resume && model_file.model_weights != io_buf::QUANTIZED_WEIGHTS && g.quantize == QUANTIZE_NONE;
     stringstream msg;
     msg << ":"<< resume << "\n";
     bin_text_read_write_fixed(model_file,(char *)&resume, sizeof (resume),
@@ -869,9 +979,22 @@ void save_load(gd& g, io_buf& model_file, bool read, bool text)
       // save_load_online_state(g, model_file, read, text);
       save_load_online_state(all, model_file, read, text, &g);
     }
-    else
+    else if (g.quantize != QUANTIZE_NONE)
+    { if (text)
+        THROW("a quantized model can not be written as text");
+      if (read)
+        g.quantized = new quantized_weights(g.quantize, all.length(), all.weights.stride_shift());
+      g.quantized->save_load(model_file, read);
+    }
+    else if (model_file.model_weights == io_buf::QUANTIZED_WEIGHTS)
+    { quantized_weights quantized(all.quantize, all.length(), all.weights.stride_shift());
+      quantized.quantize(all.weights.dense_weights, (float)all.sd->gravity, (float)all.sd->contraction);
+      quantized.save_load(model_file, false);
+    }
+    else if (!mapped)
       save_load_regressor(all, model_file, read, text);
   }
+  model_file.model_weights = io_buf::FLOAT_WEIGHTS; // the weights were left out or quantized, if asked
 }
 
 template<bool sparse_l2, bool invariant, bool sqrt_rate, uint64_t adaptive, uint64_t normalized, uint64_t spare, uint64_t next>
@@ -924,6 +1047,38 @@ uint64_t set_learn(vw& all, bool feature_mask_off, gd& g)
     return set_learn<sqrt_rate, 0, 0>(all, feature_mask_off, g);
 }
 
+struct quantized_multipredict_data
+{ size_t count;
+  size_t step;
+  polyprediction* pred;
+  quantized_weights* weights;
+};
+
+template<quantization kind>
+inline void vec_add_quantized_multipredict(quantized_multipredict_data& mp, const float fx, uint64_t fi)
+{ for (size_t c = 0; c < mp.count; c++, fi += mp.step)
+    mp.pred[c].scalar += fx * mp.weights->get<kind>(fi);
+}
+
+template<quantization kind>
+void multipredict_quantized(gd& g, base_learner&, example& ec, size_t count, size_t step, polyprediction*pred, bool finalize_predictions)
+{ vw& all = *g.all;
+  for (size_t c=0; c<count; c++)
+    pred[c].scalar = ec.l.simple.initial;
+  quantized_multipredict_data mp = { count, step, pred, g.quantized };
+  foreach_feature<quantized_multipredict_data, uint64_t, vec_add_quantized_multipredict<kind>, quantized_weights>(all, *g.quantized, ec, mp);
+  if (finalize_predictions)
+    for (size_t c=0; c<count; c++)
+      pred[c].scalar = finalize_prediction(all.sd, pred[c].scalar);
+}
+
+void finish(gd& g)
+{ delete g.quantized;
+  free_flat(g.flat);
+  if (g.async != nullptr)
+    destroy_async_avg(g.async);
+}
+
 uint64_t ceil_log_2(uint64_t v)
 { if (v==0)
     return 0;
@@ -937,24 +1092,28 @@ base_learner* setup(vw& all)
   ("adaptive", "use adaptive, individual learning rates.")
   ("invariant", "use safe/importance aware updates.")
   ("normalized", "use per feature normalized updates")
-  ("sparse_l2", po::value<float>()->default_value(0.f), "use per feature normalized updates");
+  ("sparse_l2", po::value<float>()->default_value(0.f), "use per feature normalized updates")
+  ("quantized", po::value<string>(), "the model's weights are fp16 or int8, so it only predicts")
+  ("flat_features", "copy each example's linear features into one contiguous block for the passes of an update")
+  ("async_allreduce", "average the weights over the --span_server nodes while the next pass learns, folding each average in a pass late");
   add_options(all);
   po::variables_map& vm = all.vm;
   gd& g = calloc_or_throw<gd>();
   g.all = &all;
   g.all->normalized_sum_norm_x = 0;
   g.no_win_counter = 0;
-  g.total_weight = 0.;
+  g.all->total_weight = 0.;
   g.early_stop_thres = 3;
   g.sparse_l2 = vm["sparse_l2"].as<float>();
   g.neg_norm_power = (all.adaptive ? (all.power_t - 1.f) : -1.f);
   g.neg_power_t = - all.power_t;
   g.adaptive = all.adaptive;
   g.normalized = all.normalized_updates;
+  g.flatten = vm.count("flat_features") > 0;
 
   if(all.initial_t > 0)//for the normalized update: if initial_t is bigger than 1 we interpret this as if we had seen (all.initial_t) previous fake datapoints all with norm 1
   { g.all->normalized_sum_norm_x = all.initial_t;
-    g.total_weight = all.initial_t;
+    g.all->total_weight = all.initial_t;
   }
 
   bool feature_mask_off = true;
@@ -971,6 +1130,16 @@ base_learner* setup(vw& all)
   { g.initial_constant = vm["constant"].as<float>();
   }
 
+  if (vm.count("quantized"))
+  { g.quantize = parse_quantization(vm["quantized"].as<string>());
+    if (all.training)
+      THROW("a quantized model only predicts, use it with -t");
+    if (all.audit || all.hash_inv || !all.text_regressor_name.empty() || !all.mapped_regressor_name.empty() || all.snapshot_every > 0)
+      THROW("a quantized model has no float weights for --audit, --invert_hash, --readable_model, --mapped_regressor or --snapshot_every");
+    *all.file_options << " --quantized " << quantization_name(g.quantize);
+    all.weights.memory.reserve_only = true; // gd predicts from g.quantized instead
+  }
+
   if( vm.count("sgd") || vm.count("adaptive") || vm.count("invariant") || vm.count("normalized") )
   { //nondefault
     all.adaptive = all.training && vm.count("adaptive");
@@ -996,6 +1165,14 @@ base_learner* setup(vw& all)
 	 all.normalized_updates = all.training;
   }
 
+  if (vm.count("async_allreduce") && all.all_reduce != nullptr && all.training)
+  { if (all.adaptive)
+      THROW("--async_allreduce averages the weights plainly, so it needs --sgd or updates without --adaptive");
+    if (vm.count("stage_poly")) // the average would share all.all_reduce's sockets with its own
+      THROW("--async_allreduce can not be used with --stage_poly, which allreduces while the average runs");
+    g.async = create_async_avg(all);
+  }
+
   if (pow((double)all.eta_decay_rate, (double)all.numpasses) < 0.0001 )
     all.trace_message << "Warning: the learning rate for the last pass is multiplied by: " << pow((double)all.eta_decay_rate, (double)all.numpasses)
          << " adjust --decay_learning_rate larger to avoid this." << endl;
@@ -1015,6 +1192,12 @@ base_learner* setup(vw& all)
   else
   { g.predict = predict<false, false>;   g.multipredict = multipredict<false, false>;
   }
+  if (g.quantize == QUANTIZE_FP16)
+  { g.predict = predict_quantized<QUANTIZE_FP16>;  g.multipredict = multipredict_quantized<QUANTIZE_FP16>;
+  }
+  else if (g.quantize == QUANTIZE_INT8)
+  { g.predict = predict_quantized<QUANTIZE_INT8>;  g.multipredict = multipredict_quantized<QUANTIZE_INT8>;
+  }
 
   uint64_t stride;
   if (all.power_t == 0.5)
@@ -1031,6 +1214,7 @@ base_learner* setup(vw& all)
   ret.set_update(g.update);
   ret.set_save_load(save_load);
   ret.set_end_pass(end_pass);
+  ret.set_finish(finish);
   return make_base(ret);
 }
 
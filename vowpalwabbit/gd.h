@@ -53,9 +53,26 @@ inline void vec_add_multipredict(multipredict_info<T>& mp, const float fx, uint6
 // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
 template <class R, void (*T)(R&, const float, float&), class W>
 inline void foreach_feature(W& weights, features& fs, R& dat, uint64_t offset = 0, float mult = 1.)
-{
-  for (features::iterator& f : fs)
+{ if (fs.nonempty() && INTERACTIONS::batch_T<R, float&, T, W>::run(dat, weights, fs.values.begin(), fs.indicies.begin(), fs.size(), mult, 0, offset))
+    return;
+  if (!weights.prefetching())
+  { for (features::iterator& f : fs)
       T(dat, mult*f.value(), weights[(f.index() + offset)]);
+    return;
+  }
+
+  features::iterator ahead = fs.begin();
+  features::iterator end = fs.end();
+  for (size_t i = 0; i < prefetch_ahead && ahead != end; ++i, ++ahead)
+    weights.prefetch(ahead.index() + offset);
+
+  for (features::iterator& f : fs)
+  { if (ahead != end)
+    { weights.prefetch(ahead.index() + offset);
+      ++ahead;
+    }
+    T(dat, mult*f.value(), weights[(f.index() + offset)]);
+  }
 }
   
  // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
@@ -76,39 +93,73 @@ void foreach_feature(W& /*weights*/, features& fs, R&dat, uint64_t offset = 0, f
     T(dat, mult*f.value(), f.index() + offset);
 }
 
+// iterate through all namespaces and quadratic&cubic features of ec with the given weights,
+// callback function T(some_data_R, feature_value_x, S)
+template <class R, class S, void (*T)(R&, float, S), class W>
+inline void foreach_feature(vw& all, W& weights, example& ec, R& dat)
+{ uint64_t offset = ec.ft_offset;
+  if (all.ignore_some_linear)
+    for (example::iterator i = ec.begin (); i != ec.end(); ++i)
+      {
+        if (!all.ignore_linear[i.index()])
+          {
+            features& f = *i;
+            foreach_feature<R, T, W>(weights, f, dat, offset);
+          }
+      }
+  else
+    for (features& f : ec)
+      foreach_feature<R, T, W>(weights, f, dat, offset);
+
+  INTERACTIONS::generate_interactions<R, S, T, false, INTERACTIONS::dummy_func<R>, W>(all, ec, dat, weights);
+}
+
+// The linear features of an example copied into one allocation, all the indices and then all the
+// values, so that a pass over them is one run rather than one per namespace.  Filled by
+// flatten_linear, which leaves out namespaces --ignore_linear drops.
+struct flat_features
+{ feature_index* indices; // capacity of them, followed by capacity values
+  feature_value* values;
+  size_t size;
+  size_t capacity;
+};
+
+void flatten_linear(vw& all, example& ec, flat_features& flat);
+void free_flat(flat_features& flat);
+
+// as above, with the linear features of ec read from flat, which flatten_linear filled from ec
+template <class R, class S, void (*T)(R&, float, S), class W>
+inline void foreach_feature(vw& all, W& weights, example& ec, flat_features& flat, R& dat)
+{ uint64_t offset = ec.ft_offset;
+  const feature_index* indices = flat.indices;
+  const feature_value* values = flat.values;
+  size_t n = flat.size;
+  if (n > 0 && !INTERACTIONS::batch_T<R, S, T, W>::run(dat, weights, values, indices, n, 1.f, 0, offset))
+  { if (!INTERACTIONS::prefetching_T<R, T>(weights))
+      for (size_t i = 0; i < n; i++)
+        INTERACTIONS::call_T<R, T>(dat, weights, values[i], indices[i] + offset);
+    else
+    { for (size_t i = 0; i < prefetch_ahead && i < n; i++)
+        weights.prefetch(indices[i] + offset);
+      for (size_t i = 0; i < n; i++)
+      { if (i + prefetch_ahead < n)
+          weights.prefetch(indices[i + prefetch_ahead] + offset);
+        INTERACTIONS::call_T<R, T>(dat, weights, values[i], indices[i] + offset);
+      }
+    }
+  }
+
+  INTERACTIONS::generate_interactions<R, S, T, false, INTERACTIONS::dummy_func<R>, W>(all, ec, dat, weights);
+}
+
 // iterate through all namespaces and quadratic&cubic features, callback function T(some_data_R, feature_value_x, S)
 // where S is EITHER float& feature_weight OR uint64_t feature_index
 template <class R, class S, void (*T)(R&, float, S)>
 inline void foreach_feature(vw& all, example& ec, R& dat)
-{ uint64_t offset = ec.ft_offset;
-  if (all.weights.sparse)
-    if (all.ignore_some_linear)
-      for (example::iterator i = ec.begin (); i != ec.end(); ++i)
-        {
-          if (!all.ignore_linear[i.index()])
-            {
-              features& f = *i;
-              foreach_feature<R, T, sparse_parameters>(all.weights.sparse_weights, f, dat, offset);
-            }
-        }
-    else
-      for (features& f : ec)
-        foreach_feature<R, T, sparse_parameters>(all.weights.sparse_weights, f, dat, offset);
+{ if (all.weights.sparse)
+    foreach_feature<R, S, T, sparse_parameters>(all, all.weights.sparse_weights, ec, dat);
   else
-    if (all.ignore_some_linear)
-      for (example::iterator i = ec.begin (); i != ec.end(); ++i)
-        {
-          if (!all.ignore_linear[i.index()])
-            {
-              features& f = *i;
-              foreach_feature<R, T, dense_parameters>(all.weights.dense_weights, f, dat, offset);
-            }
-        }
-    else
-      for (features& f : ec)
-        foreach_feature<R, T, dense_parameters>(all.weights.dense_weights, f, dat, offset);
-
-  INTERACTIONS::generate_interactions<R,S,T>(all, ec, dat);
+    foreach_feature<R, S, T, dense_parameters>(all, all.weights.dense_weights, ec, dat);
 }
 
 // iterate through all namespaces and quadratic&cubic features, callback function T(some_data_R, feature_value_x, feature_weight)
@@ -125,6 +176,14 @@ inline float inline_predict(vw& all, example& ec)
   return temp;
 }
 
+// the same with weights other than all.weights, e.g. a snapshot of them
+template <class W>
+inline float inline_predict(vw& all, W& weights, example& ec)
+{ float temp = ec.l.simple.initial;
+  foreach_feature<float, float&, vec_add, W>(all, weights, ec, temp);
+  return temp;
+}
+
 inline float sign(float w) { if (w < 0.) return -1.; else  return 1.; }
 
 inline float trunc_weight(const float w, const float gravity)
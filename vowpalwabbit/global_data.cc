@@ -438,6 +438,8 @@ vw::vw()
 
   reg_mode = 0;
   current_pass = 0;
+  normalized_sum_norm_x = 0.;
+  total_weight = 0.;
   reduction_stack=v_init<LEARNER::base_learner* (*)(vw&)>();
 
   data_filename = "";
@@ -452,6 +454,11 @@ vw::vw()
   default_bits = true;
   daemon = false;
   num_children = 10;
+  io_threads = 0;
+  io_batch_size = 1;
+  io_batch_wait = 0;
+  snapshot_every = 0;
+  learner_threads = 1;
   save_resume = false;
   preserve_performance_counters = false;
 
@@ -493,6 +500,10 @@ vw::vw()
   initial_constant = 0.0;
 
   all_reduce = nullptr;
+  sparse_allreduce = 0.f;
+  allreduce_base = nullptr;
+  allreduce_encoding = QUANTIZE_NONE;
+  allreduce_error_feedback = false;
 
   for (size_t i = 0; i < 256; i++)
   { ngram[i] = 0;
@@ -531,6 +542,7 @@ vw::vw()
 
   hash_inv = false;
   print_invert = false;
+  quantize = QUANTIZE_FP16;
 
   // Set by the '--progress <arg>' option and affect sd->dump_interval
   progress_add = false;   // default is multiplicative progress dumps
@@ -17,6 +17,7 @@ namespace po = boost::program_options;
 
 #include "v_array.h"
 #include "array_parameters.h"
+#include "quantized_weights.h"
 #include "parse_primitives.h"
 #include "loss_functions.h"
 #include "comp_io.h"
@@ -443,6 +444,11 @@ struct vw
 #endif
   AllReduceType all_reduce_type;
   AllReduce* all_reduce;
+  float sparse_allreduce; // the largest fraction of a vector the nodes exchange as changed entries rather than whole, 0 to always send it whole
+  float* allreduce_base;  // the weights accumulate_avg last left every node with, which the next exchanges changes from
+  quantization allreduce_encoding; // of the vectors accumulate sums whole, QUANTIZE_NONE to send floats
+  bool allreduce_error_feedback;   // whether a node adds what the encoding dropped from its vector into the next
+  std::map<size_t, float*> allreduce_residuals; // what the encoding dropped, by offset into the weights
 
   LEARNER::base_learner* l;//the top level learner
   LEARNER::base_learner* scorer;//a scoring function
@@ -461,6 +467,11 @@ struct vw
 
   bool daemon;
   size_t num_children;
+  size_t io_threads; // threads multiplexing daemon connections in this process, see --io_threads
+  size_t io_batch_size; // examples an I/O thread predicts together
+  size_t io_batch_wait; // microseconds an I/O thread waits for a batch to fill
+  size_t snapshot_every; // with --io_threads, examples learned between copies of the model that predictions read
+  size_t learner_threads; // threads learning from the ring on a shared weight table, see --learner_threads
 
   bool save_per_pass;
   float initial_weight;
@@ -475,6 +486,7 @@ struct vw
 
   version_struct model_file_ver;
   double normalized_sum_norm_x;
+  double total_weight;       // of the examples summed into normalized_sum_norm_x
   bool vw_is_main;  // true if vw is executable; false in library mode
 
   po::options_description opts;
@@ -553,6 +565,9 @@ struct vw
 
   std::string text_regressor_name;
   std::string inv_hash_regressor_name;
+  std::string mapped_regressor_name;
+  std::string quantized_regressor_name;
+  quantization quantize; // of the weights of --quantized_regressor
 
   size_t length () { return ((size_t)1) << num_bits; };
 
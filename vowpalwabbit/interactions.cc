@@ -1,5 +1,9 @@
 #include "interactions.h"
 #include "vw_exception.h"
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(VW_NO_INLINE_SIMD)
+#define INTERACTIONS_SIMD
+#include <immintrin.h>
+#endif
 using namespace std;
 namespace INTERACTIONS
 {
@@ -457,4 +461,70 @@ void eval_count_of_generated_ft(vw& all, example& ec, size_t& new_features_cnt,
 
 
 
+/*
+ *  Vector kernel for dense weights
+ */
+
+#ifdef INTERACTIONS_SIMD
+
+inline bool have_avx2()
+{ __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+const bool avx2 = have_avx2();
+
+// The rates are gathered and the increments formed in the lanes, then added to the weights one
+// at a time and in order, so features that hash to the same weight need no special care and
+// the weights come out as the scalar loop leaves them.  Gathering the rates is what pays, the
+// scalar loop is as quick when there are none.
+__attribute__((target("avx2")))
+void update_avx2(float update, weight* w, uint64_t mask, size_t spare, const feature_value* values, const feature_index* indices,
+                 size_t n, feature_value ft_value, feature_index halfhash, uint64_t offset)
+{ const __m256i vhalfhash = _mm256_set1_epi64x(halfhash);
+  const __m256i voffset = _mm256_set1_epi64x(offset);
+  const __m256i vmask = _mm256_set1_epi64x(mask);
+  const __m128 vft = _mm_set1_ps(ft_value);
+  const __m128 vupdate = _mm_set1_ps(update);
+  uint64_t lanes[4];
+  float increments[4];
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  { __m256i idx = _mm256_loadu_si256((const __m256i*)(indices + i));
+    idx = _mm256_and_si256(_mm256_add_epi64(_mm256_xor_si256(idx, vhalfhash), voffset), vmask);
+    __m128 x = _mm_mul_ps(vft, _mm_loadu_ps(values + i));
+    x = _mm_mul_ps(x, _mm256_i64gather_ps(w + spare, idx, 4));
+    _mm256_storeu_si256((__m256i*)lanes, idx);
+    _mm_storeu_ps(increments, _mm_mul_ps(vupdate, x));
+    w[lanes[0]] += increments[0];
+    w[lanes[1]] += increments[1];
+    w[lanes[2]] += increments[2];
+    w[lanes[3]] += increments[3];
+  }
+  for (; i < n; ++i)
+  { weight* fw = w + (((indices[i] ^ halfhash) + offset) & mask);
+    float x = ft_value * values[i];
+    x *= fw[spare];
+    fw[0] += update * x;
+  }
+}
+
+bool dense_update(float update, weight* w, uint64_t mask, size_t spare, const feature_value* values, const feature_index* indices,
+                  size_t n, feature_value ft_value, feature_index halfhash, uint64_t offset)
+{ // shorter runs are quicker in the scalar loop
+  if (!avx2 || spare == 0 || n < 16)
+    return false;
+  update_avx2(update, w, mask, spare, values, indices, n, ft_value, halfhash, offset);
+  return true;
+}
+
+#else
+
+bool dense_update(float, weight*, uint64_t, size_t, const feature_value*, const feature_index*, size_t, feature_value,
+                  feature_index, uint64_t)
+{ return false;
+}
+
+#endif
+
 }
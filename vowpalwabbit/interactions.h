@@ -65,6 +65,34 @@ inline void call_T(R& dat, W& /*weights*/, const float ft_value, const uint64_t
     T(dat, ft_value, ft_idx);
 }
 
+// Callbacks whose effect on a run of features can be computed in vector lanes specialize this
+// for dense weights, see dense_update.  run returns false to take the scalar loop.
+template <class R, class S, void (*T)(R&, float, S), class W>
+struct batch_T
+{ static bool run(R& /*dat*/, W& /*weights*/, const feature_value* /*values*/, const feature_index* /*indices*/, size_t /*n*/,
+                  feature_value /*ft_value*/, feature_index /*halfhash*/, uint64_t /*offset*/)
+  { return false; }
+};
+
+// Vector kernel for a run of n features hashed as ((indices[i] ^ halfhash) + offset) & mask into
+// dense weights w, with values x = ft_value * values[i].  Adds update * x, scaled by the weight's
+// rate at w[spare], to each weight, exactly like GD::update_feature without a feature mask.
+// Returns false when the cpu lacks AVX2, spare is 0 or the run is too short to gain from it.
+bool dense_update(float update, weight* w, uint64_t mask, size_t spare, const feature_value* values, const feature_index* indices,
+                  size_t n, feature_value ft_value, feature_index halfhash, uint64_t offset);
+
+template <class R, void (*T)(R&, float, float&), class W>
+inline bool prefetching_T(W& weights)
+{
+    return weights.prefetching();
+}
+
+template <class R, void (*T)(R&, float, uint64_t), class W>
+inline bool prefetching_T(W& /*weights*/)
+{
+    return false;
+}
+
 // state data used in non-recursive feature generation algorithm
 // contains N feature_gen_data records (where N is length of interaction)
 struct feature_gen_data
@@ -101,10 +129,25 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
       audit_func(dat, nullptr);
     }
   }
-  else
+  else if (begin != end && batch_T<R, S, T, W>::run(dat, weights, &begin.value(), &begin.index(), end - begin, ft_value, halfhash, offset))
+    return;
+  else if (!prefetching_T<R, T>(weights))
   { for (; begin != end; ++begin)
       call_T<R, T>(dat, weights, INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
   }
+  else
+  { features::iterator_all ahead = begin;
+    for (size_t i = 0; i < prefetch_ahead && ahead != end; ++i, ++ahead)
+      weights.prefetch((ahead.index() ^ halfhash) + offset);
+
+    for (; begin != end; ++begin)
+    { if (ahead != end)
+      { weights.prefetch((ahead.index() ^ halfhash) + offset);
+        ++ahead;
+      }
+      call_T<R, T>(dat, weights, INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
+    }
+  }
 }
 
 
@@ -114,7 +157,7 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
  template <class R, class S, void(*T)(R&, float, S), bool audit, void(*audit_func)(R&, const audit_strings*), class W> // nullptr func can't be used as template param in old compilers
  inline void generate_interactions(vw& all, example& ec, R& dat, W& weights) // default value removed to eliminate ambiguity in old complers
  {
-   features* features_data = ec.feature_space;
+   namespace_table& features_data = ec.feature_space;
 
   // often used values
   const uint64_t offset = ec.ft_offset;
@@ -6,6 +6,9 @@ license as described in the file LICENSE.
 #include "io_buf.h"
 #ifdef WIN32
 #include <winsock2.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 size_t buf_read(io_buf &i, char* &pointer, size_t n)
@@ -16,14 +19,16 @@ size_t buf_read(io_buf &i, char* &pointer, size_t n)
     return n;
   }
   else // out of bytes, so refill.
-  { if (i.head != i.space.begin()) //There exists room to shift.
+  { if (i.mapping != nullptr)
+      i.unmap(); // moves the unread tail of the mapping into the buffer
+    else if (i.head != i.space.begin()) //There exists room to shift.
     { // Out of buffer so swap to beginning.
       size_t left = i.space.end() - i.head;
       memmove(i.space.begin(), i.head, left);
       i.head = i.space.begin();
       i.space.end() = i.space.begin() + left;
     }
-    if (i.fill(i.files[i.current]) > 0) // read more bytes from current file if present
+    if (i.current < i.files.size() && i.fill(i.files[i.current]) > 0) // read more bytes from current file if present
       return buf_read(i, pointer, n);// more bytes are read.
     else if (++i.current < i.files.size())
       return buf_read(i, pointer, n);// No more bytes, so go to next file and try again.
@@ -60,7 +65,11 @@ size_t readto(io_buf &i, char* &pointer, char terminal)
     return n+1;
   }
   else
-  { if (i.space.end() == i.space.end_array)
+  { if (i.mapping != nullptr)
+    { i.unmap();
+      pointer = i.space.end();
+    }
+    else if (i.space.end() == i.space.end_array)
     { size_t left = i.space.end() - i.head;
       memmove(i.space.begin(), i.head, left);
       i.head = i.space.begin();
@@ -98,6 +107,58 @@ void buf_write(io_buf &o, char* &pointer, size_t n)
   }
 }
 
+bool io_buf::map_rest(int f)
+{
+#ifdef _WIN32
+  return false;
+#else
+  if (compressed())
+    return false;
+  struct stat st;
+  if (fstat(f, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  off_t offset = lseek(f, 0, SEEK_CUR);
+  if (offset < 0 || offset >= st.st_size)
+    return false;
+
+  // private and writable, so in-place edits of the input (e.g. '\0' terminating a line) stay local
+  void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, f, 0);
+  if (m == MAP_FAILED)
+    return false;
+  madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  madvise(m, (size_t)st.st_size, MADV_HUGEPAGE);
+#endif
+  lseek(f, st.st_size, SEEK_SET);
+
+  mapping = (char*)m;
+  mapping_size = (size_t)st.st_size;
+  buffer = space;
+  space.begin() = mapping + offset;
+  space.end() = mapping + mapping_size;
+  space.end_array = space.end();
+  head = space.begin();
+  return true;
+#endif
+}
+
+void io_buf::unmap()
+{ if (mapping == nullptr)
+    return;
+  size_t left = space.end() - head;
+  char* rest = head;
+  space = buffer;
+  if ((size_t)(space.end_array - space.begin()) < left)
+    space.resize(left);
+  memcpy(space.begin(), rest, left);
+  space.end() = space.begin() + left;
+  head = space.begin();
+#ifndef _WIN32
+  munmap(mapping, mapping_size);
+#endif
+  mapping = nullptr;
+}
+
 bool io_buf::is_socket(int f)
 { // this appears to work in practice, but could probably be done in a cleaner fashion
   const int _nhandle = 32;
@@ -48,6 +48,10 @@ license as described in the file LICENSE.
 ** The interval [space.head, space.end] may be shifted down to space.begin
 ** if the requested number of bytes to be read is larger than the interval size.
 ** This is done to avoid reallocating arrays as much as possible.
+**
+** With map_files set, a refill from a regular file maps the rest of the file instead of
+** reading it: space then views the mapping, so buf_read hands out pointers into the page
+** cache, and buffer holds the allocated array until the mapping is released.
 */
 
 class io_buf
@@ -65,9 +69,24 @@ public:
   bool verify_hash;
   uint32_t hash;
 
+  bool map_files; // refill from regular files by mapping them
+  char* mapping;
+  size_t mapping_size;
+  v_array<char> buffer;
+
+  int model_weights; // how gd saves or loads the weights of the model this buffer holds
+
   static const int READ = 1;
   static const int WRITE = 2;
 
+  // model_weights: gd saves and loads FLOAT_WEIGHTS itself, but leaves out the MAPPED_WEIGHTS of
+  // a --mapped_regressor model, which are read or written apart, and writes the QUANTIZED_WEIGHTS
+  // of a --quantized_regressor model quantized to all.quantize.  gd sets model_weights back to
+  // FLOAT_WEIGHTS once done, which tells the writer that a learner kept its weights through gd.
+  static const int FLOAT_WEIGHTS = 0;
+  static const int MAPPED_WEIGHTS = 1;
+  static const int QUANTIZED_WEIGHTS = 2;
+
   void init()
   { space = v_init<char>();
     files = v_init<int>();
@@ -80,6 +99,11 @@ public:
     head = space.begin();
     verify_hash = false;
     hash = 0;
+    map_files = false;
+    mapping = nullptr;
+    mapping_size = 0;
+    buffer = v_init<char>();
+    model_weights = FLOAT_WEIGHTS;
   }
 
   virtual int open_file(const char* name, bool stdin_off, int flag=READ)
@@ -125,7 +149,7 @@ public:
   }
 
   virtual void reset_file(int f)
-  {
+  { unmap();
 #ifdef _WIN32
     _lseek(f, 0, SEEK_SET);
 #else
@@ -140,7 +164,8 @@ public:
   }
 
   virtual ~io_buf()
-  { files.delete_v();
+  { unmap();
+    files.delete_v();
     space.delete_v();
   }
 
@@ -154,8 +179,15 @@ public:
 
   static ssize_t read_file_or_socket(int f, void* buf, size_t nbytes);
 
+  bool map_rest(int f);
+  void unmap();
+
   ssize_t fill(int f)
-  { // if the loaded values have reached the allocated space
+  { if (mapping != nullptr)
+      unmap();
+    if (map_files && head == space.end() && map_rest(f))
+      return space.end() - head;
+    // if the loaded values have reached the allocated space
     if (space.end_array - space.end() == 0)
     { // reallocate to twice as much space
       size_t head_loc = head - space.begin();
@@ -188,7 +220,8 @@ public:
 
   virtual bool close_file()
   { if(files.size()>0)
-    { close_file_or_socket(files.pop());
+    { unmap();
+      close_file_or_socket(files.pop());
       return true;
     }
     return false;
@@ -1,3 +1,6 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "parser.h"
 #include "vw.h"
 #include "parse_regressor.h"
@@ -32,6 +35,20 @@ const char* to_string(prediction_type_t prediction_type)
 
 namespace LEARNER
 {
+bool is_save_command(example* ec)
+{ return ec->tag.size() >= 4 && !strncmp((const char*) ec->tag.begin(), "save", 4); }
+
+void save_state(vw& all, example* ec)
+{ string final_regressor_name = all.final_regressor_name;
+
+  if ((ec->tag).size() >= 6 && (ec->tag)[4] == '_')
+    final_regressor_name = string(ec->tag.begin()+5, (ec->tag).size()-5);
+
+  if (!all.quiet)
+    all.trace_message << "saving regressor to " << final_regressor_name << endl;
+  save_predictor(all, final_regressor_name, 0);
+}
+
 void process_example(vw& all, example* ec)
 { if (ec->indices.size() > 1) // 1+ nonconstant feature. (most common case first)
     dispatch_example(all, *ec);
@@ -39,18 +56,9 @@ void process_example(vw& all, example* ec)
   { all.l->end_pass();
     VW::finish_example(all, ec);
   }
-  else if (ec->tag.size() >= 4 && !strncmp((const char*) ec->tag.begin(), "save", 4))
+  else if (is_save_command(ec))
   { // save state command
-
-    string final_regressor_name = all.final_regressor_name;
-
-    if ((ec->tag).size() >= 6 && (ec->tag)[4] == '_')
-      final_regressor_name = string(ec->tag.begin()+5, (ec->tag).size()-5);
-
-    if (!all.quiet)
-      all.trace_message << "saving regressor to " << final_regressor_name << endl;
-    save_predictor(all, final_regressor_name, 0);
-
+    save_state(all, ec);
     VW::finish_example(all,ec);
   }
   else // empty example
@@ -86,6 +94,87 @@ void generic_driver(vector<vw*> alls)
     (*it)->l->end_examples();
 }
 
+// Examples are taken from the ring one at a time and learned from concurrently, without
+// locks on the weights.  finish_example accumulates into all.sd and prints progress, so
+// it is serialized.  The end of a pass and save commands wait for every example in flight,
+// so that they see the weights at rest, and no example is taken until they are done.
+struct learner_pool
+{ vw* all;
+  mutex take;                  // held while taking an example, and across a barrier
+  mutex account;               // held while finishing an example, guards the members below
+  condition_variable settled;  // signalled when in_flight drops to 0 or a thread fails
+  size_t in_flight;            // examples taken and not yet finished
+  exception_ptr error;         // the first exception thrown on a learner thread
+};
+
+void learn_from_ring(learner_pool& pool)
+{ vw& all = *pool.all;
+  while (true)
+  { example* ec;
+    { lock_guard<mutex> taking(pool.take);
+      if (all.early_terminate || (ec = VW::get_example(all.p)) == nullptr)
+        return;
+      unique_lock<mutex> accounting(pool.account);
+      if (pool.error != nullptr)
+        return;
+      if (ec->indices.size() <= 1 && (ec->end_pass || is_save_command(ec)))
+      { pool.settled.wait(accounting, [&pool] { return pool.in_flight == 0 || pool.error != nullptr; });
+        if (pool.error != nullptr)
+          return;
+        process_example(all, ec);
+        continue;
+      }
+      pool.in_flight++;
+    }
+
+    if (ec->test_only || !all.training)
+      all.l->predict(*ec);
+    else
+      all.l->learn(*ec);
+
+    lock_guard<mutex> accounting(pool.account);
+    all.l->finish_example(all, *ec);
+    if (--pool.in_flight == 0)
+      pool.settled.notify_all();
+  }
+}
+
+void learner_thread(learner_pool& pool)
+{ try
+  { learn_from_ring(pool);
+  }
+  catch (...)
+  { lock_guard<mutex> accounting(pool.account);
+    if (pool.error == nullptr)
+      pool.error = current_exception();
+    pool.settled.notify_all();
+  }
+}
+
+void threaded_driver(vw& all)
+{ learner_pool pool;
+  pool.all = &all;
+  pool.in_flight = 0;
+
+  vector<thread> threads;
+  for (size_t i = 0; i < all.learner_threads; i++)
+    threads.push_back(thread(learner_thread, ref(pool)));
+  for (thread& t : threads)
+    t.join();
+  if (pool.error != nullptr)
+    rethrow_exception(pool.error);
+
+  example* ec;
+  if (all.early_terminate) //drain any extra examples from parser.
+    while ((ec = VW::get_example(all.p)) != nullptr)
+      VW::finish_example(all, ec);
+  all.l->end_examples();
+}
+
 void generic_driver(vw& all)
-{ generic_driver<vw&, process_example>(all, all); }
+{ if (all.learner_threads > 1)
+    threaded_driver(all);
+  else
+    generic_driver<vw&, process_example>(all, all);
+}
 }
@@ -77,6 +77,11 @@ struct finish_example_data
 void generic_driver(vw& all);
 void generic_driver(std::vector<vw*> alls);
 
+// An example tagged "save" or "save_<filename>" asks for the model to be saved, to the final
+// regressor or to <filename>.
+bool is_save_command(example* ec);
+void save_state(vw& all, example* ec);
+
 inline void noop_sl(void*, io_buf&, bool, bool) {}
 inline void noop(void*) {}
 inline float noop_sensitivity(void*, base_learner&, example&) { return 0.; }
@@ -15,6 +15,7 @@ license as described in the file LICENSE.
 #include "accumulate.h"
 #include "best_constant.h"
 #include "vw_exception.h"
+#include "daemon_server.h"
 #include <fstream>
 
 using namespace std;
@@ -94,13 +95,17 @@ int main(int argc, char *argv[])
     struct timeb t_start, t_end;
     ftime(&t_start);
 
-    VW::start_parser(all);
-    if (alls.size() == 1)
-      LEARNER::generic_driver(all);
+    if (all.io_threads > 0)
+      serve_connections(all);
     else
-      LEARNER::generic_driver(alls);
+    { VW::start_parser(all);
+      if (alls.size() == 1)
+        LEARNER::generic_driver(all);
+      else
+        LEARNER::generic_driver(alls);
 
-    VW::end_parser(all);
+      VW::end_parser(all);
+    }
 
     ftime(&t_end);
     double net_time = (int) (1000.0 * (t_end.time - t_start.time) + (t_end.millitm - t_start.millitm));
@@ -0,0 +1,140 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <string.h>
+#include <float.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "gd.h"
+#include "loss_functions.h"
+#include "model_snapshot.h"
+
+using namespace std;
+
+// A pinned pointer per reader, padded so that readers do not share a cache line.
+struct snapshot_pin
+{ atomic<model_snapshot*> pinned;
+  char padding[64 - sizeof(atomic<model_snapshot*>)];
+
+  snapshot_pin() : pinned(nullptr) {}
+};
+
+struct snapshot_store
+{ atomic<model_snapshot*> current;
+  vector<snapshot_pin> pins;
+  vector<model_snapshot*> retired; // replaced snapshots, only touched by the publisher
+  size_t published;
+  double copy_time;                // microseconds spent copying, over all publications
+
+  snapshot_store(size_t readers) : current(nullptr), pins(readers), published(0), copy_time(0.) {}
+};
+
+snapshot_store* create_snapshots(size_t readers)
+{ return new snapshot_store(readers);
+}
+
+void destroy_snapshots(snapshot_store* store)
+{ delete store->current.load();
+  for (model_snapshot* s : store->retired)
+    delete s;
+  delete store;
+}
+
+bool pinned(snapshot_store& store, model_snapshot* s)
+{ for (snapshot_pin& pin : store.pins)
+    if (pin.pinned.load() == s)
+      return true;
+  return false;
+}
+
+// A retired snapshot no reader has pinned, or a new one.  A reader that pins a retired
+// snapshot after it is checked here sees that it is no longer current and lets it go.
+model_snapshot* free_snapshot(vw& all, snapshot_store& store)
+{ for (size_t i = 0; i < store.retired.size(); i++)
+  { model_snapshot* s = store.retired[i];
+    if (!pinned(store, s))
+    { store.retired.erase(store.retired.begin() + i);
+      return s;
+    }
+  }
+  dense_parameters& weights = all.weights.dense_weights;
+  weight_memory memory = all.weights.memory;
+  return new model_snapshot((weights.mask() + 1) >> weights.stride_shift(), weights.stride_shift(), memory);
+}
+
+void publish_snapshot(vw& all, shared_data& sd, snapshot_store& store, size_t learned)
+{ chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  model_snapshot* s = free_snapshot(all, store);
+
+  // predictions only read the first weight of each stride
+  dense_parameters& weights = all.weights.dense_weights;
+  weight* from = weights.first();
+  weight* to = s->weights.first();
+  size_t length = (weights.mask() + 1) >> weights.stride_shift();
+  uint32_t shift = weights.stride_shift();
+  float gravity = (float)sd.gravity;
+  float contraction = (float)sd.contraction;
+  if (gravity == 0.f && contraction == 1.f)
+    for (size_t i = 0; i < length; i++)
+      to[i] = from[i << shift];
+  else
+    for (size_t i = 0; i < length; i++)
+      to[i] = GD::trunc_weight(from[i << shift], gravity) * contraction;
+  memcpy(&s->sd, &sd, sizeof(shared_data));
+  s->sd.gravity = 0.;
+  s->sd.contraction = 1.;
+  s->link = scorer_link(all);
+  s->learned = learned;
+
+  model_snapshot* old = store.current.exchange(s);
+  if (old != nullptr)
+    store.retired.push_back(old);
+  store.published++;
+  store.copy_time += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+model_snapshot& pin_snapshot(snapshot_store& store, size_t reader)
+{ atomic<model_snapshot*>& pin = store.pins[reader].pinned;
+  model_snapshot* s = store.current.load();
+  while (true)
+  { pin.store(s);
+    model_snapshot* now = store.current.load();
+    if (now == s)
+      return *s;
+    s = now;
+  }
+}
+
+void unpin_snapshot(snapshot_store& store, size_t reader)
+{ store.pins[reader].pinned.store(nullptr);
+}
+
+// Reads a snapshot at the indices of the table it was copied from.
+struct strided_snapshot
+{ dense_parameters& weights;
+  uint32_t stride_shift;
+
+  inline weight& operator[](size_t i) const { return weights[i >> stride_shift]; }
+  bool prefetching() const { return weights.prefetching(); }
+  inline void prefetch(size_t i) const { weights.prefetch(i >> stride_shift); }
+};
+
+void snapshot_predict(vw& all, model_snapshot& s, example& ec)
+{ strided_snapshot weights = {s.weights, s.stride_shift};
+  ec.partial_prediction = GD::inline_predict(all, weights, ec);
+  ec.pred.scalar = GD::finalize_prediction(&s.sd, ec.partial_prediction);
+  if (ec.weight > 0 && ec.l.simple.label != FLT_MAX)
+    ec.loss = all.loss->getLoss(&s.sd, ec.pred.scalar, ec.l.simple.label) * ec.weight;
+  ec.pred.scalar = s.link(ec.pred.scalar);
+}
+
+size_t snapshots_published(snapshot_store& store)
+{ return store.published;
+}
+
+double snapshot_copy_time(snapshot_store& store)
+{ return store.published > 0 ? store.copy_time / store.published : 0.;
+}
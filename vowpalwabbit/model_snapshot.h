@@ -0,0 +1,46 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include "global_data.h"
+#include "scorer.h"
+
+// A read-only copy of what a gd model under the scorer needs to predict, so that predictions
+// can be served while a single thread keeps learning on all.weights.
+struct model_snapshot
+{ dense_parameters weights; // the first weight of each stride, with gd's pending l1 truncation and
+                            // l2 contraction already applied
+  uint32_t stride_shift;    // of all.weights, which the indices of features are scaled by
+  shared_data sd;           // the label range and loss state when the copy was made
+  link_function link;
+  size_t learned;           // examples learned from when the copy was made
+
+  model_snapshot(size_t length, uint32_t stride_shift, weight_memory& memory)
+    : weights(length, 0, memory), stride_shift(stride_shift) {}
+};
+
+// Publishes snapshots to a fixed number of readers, each of which pins the current snapshot
+// before predicting from it.  Readers never wait: a pin is an atomic store and a check that the
+// snapshot is still current.  The publisher swaps in a fresh copy and recycles an older one
+// once no reader has it pinned, so at most readers + 2 copies of the weights exist.
+struct snapshot_store;
+
+snapshot_store* create_snapshots(size_t readers);
+void destroy_snapshots(snapshot_store* store);
+
+// Copies all.weights and sd, which must not change meanwhile, into a snapshot and makes it
+// current.  Only one thread may publish.
+void publish_snapshot(vw& all, shared_data& sd, snapshot_store& store, size_t learned);
+
+// The current snapshot, which stays valid for reader until it is unpinned.
+model_snapshot& pin_snapshot(snapshot_store& store, size_t reader);
+void unpin_snapshot(snapshot_store& store, size_t reader);
+
+// what the scorer and gd would predict for ec with the weights of s
+void snapshot_predict(vw& all, model_snapshot& s, example& ec);
+
+// snapshots published so far, and the mean microseconds taken to copy one
+size_t snapshots_published(snapshot_store& store);
+double snapshot_copy_time(snapshot_store& store);
@@ -14,6 +14,7 @@ license as described in the file LICENSE.
 
 #include "parse_regressor.h"
 #include "parser.h"
+#include "cache.h"
 #include "parse_primitives.h"
 #include "vw.h"
 #include "interactions.h"
@@ -233,7 +234,7 @@ void parse_dictionary_argument(vw&all, string str)
 
     // clear up ec
     ec->tag.erase(); ec->indices.erase();
-    for (size_t i=0; i<256; i++) { ec->feature_space[i].erase();}
+    for (size_t i=0; i<ec->feature_space.size(); i++) { ec->feature_space.group(i).erase();}
   }
   while ((rc != EOF) && (nread > 0));
   free(buffer);
@@ -376,7 +377,14 @@ void parse_source(vw& all)
   ("json", "Enable JSON parsing.")
   ("kill_cache,k", "do not reuse existing cache: create a new one always")
   ("compressed", "use gzip format whenever possible. If a cache file is being created, this option creates a compressed cache file. A mixture of raw-text & compressed inputs are supported with autodetection.")
-  ("no_stdin", "do not default to reading from stdin");
+  ("cache_block_size", po::value<size_t>(&(all.p->cache_block_size)), "write a new cache as independently decodable blocks of about this many bytes (e.g. 1048576), which --parse_threads decode in parallel")
+  ("cache_codec", po::value<string>(), "compress the blocks of a new block cache with none, zlib, lz4 or zstd (implies --cache_block_size 262144 unless given)")
+  ("cache_shards", po::value<size_t>(&(all.p->cache_shards)), "split the blocks of a block cache into this many contiguous ranges")
+  ("cache_shard", po::value<size_t>(&(all.p->cache_shard)), "the range of --cache_shards this process reads (default 0)")
+  ("no_stdin", "do not default to reading from stdin")
+  ("parse_threads", po::value<size_t>(&(all.p->parse_threads)), "number of threads tokenizing and hashing text or json input")
+  ("parse_chunk_size", po::value<size_t>(&(all.p->parse_chunk_size)), "number of input lines given to a parse thread at a time (default 64)")
+  ("parse_unordered", "with --parse_threads, give examples to the learner as soon as they are parsed rather than in input order");
   add_options(all);
 
   // Be friendly: if -d was left out, treat positional param as data file
@@ -403,6 +411,24 @@ void parse_source(vw& all)
     all.numpasses = (size_t) 1e5;
   }
 
+  if (vm.count("parse_unordered"))
+    all.p->parse_unordered = true;
+
+  if (all.p->parse_chunk_size == 0)
+    THROW("parse_chunk_size must be positive");
+
+  if (all.p->cache_shards == 0 || all.p->cache_shard >= all.p->cache_shards)
+    THROW("cache_shard must be less than cache_shards");
+
+  if (vm.count("cache_codec"))
+  { all.p->cache_codec = cache_codec_id(vm["cache_codec"].as<string>());
+    if (all.p->cache_block_size == 0)
+      all.p->cache_block_size = (size_t)1 << 18;
+  }
+
+  if (all.p->cache_block_size >= ((size_t)1 << 31))
+    THROW("cache_block_size must be less than 2GB");
+
   if (vm.count("compressed"))
     set_compressed(all.p);
 
@@ -1010,6 +1036,9 @@ void parse_output_model(vw& all)
 { new_options(all, "Output model")
   ("final_regressor,f", po::value< string >(), "Final regressor")
   ("readable_model", po::value< string >(), "Output human-readable final regressor with numeric features")
+  ("mapped_regressor", po::value< string >(), "Final regressor with the weight table page aligned, so that -i maps it rather than reading it")
+  ("quantized_regressor", po::value< string >(), "Final regressor that only predicts, with one weight per feature stored as --quantize")
+  ("quantize", po::value< string >(), "fp16 (default), or int8 with a scale per 64 features")
   ("invert_hash", po::value< string >(), "Output human-readable final regressor with feature names.  Computationally expensive.")
   ("save_resume", "save extra state so learning can be resumed later with new data")
   ("preserve_performance_counters", "reset performance counters when warmstarting")
@@ -1031,6 +1060,14 @@ void parse_output_model(vw& all)
   if (vm.count("readable_model"))
     all.text_regressor_name = vm["readable_model"].as<string>();
 
+  if (vm.count("mapped_regressor"))
+    all.mapped_regressor_name = vm["mapped_regressor"].as<string>();
+
+  if (vm.count("quantized_regressor"))
+    all.quantized_regressor_name = vm["quantized_regressor"].as<string>();
+  if (vm.count("quantize"))
+    all.quantize = parse_quantization(vm["quantize"].as<string>());
+
   if (vm.count("invert_hash"))
   { all.inv_hash_regressor_name = vm["invert_hash"].as<string>();
     all.hash_inv = true;
@@ -1182,7 +1219,8 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
 
     new_options(all, "VW options")
     ("random_seed", po::value<uint64_t>(&(all.random_seed)), "seed random number generator")
-    ("ring_size", po::value<size_t>(&(all.p->ring_size)), "size of example ring");
+    ("ring_size", po::value<size_t>(&(all.p->ring_size)), "size of example ring")
+    ("ring_spin", po::value<size_t>(&(all.p->ring_spin)), "number of times a waiting parser or learner polls the example ring before blocking (default 0)");
     add_options(all);
 
     new_options(all, "Update options")
@@ -1199,6 +1237,8 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
     ("initial_weight", po::value<float>(&(all.initial_weight)), "Set all weights to an initial value of arg.")
     ("random_weights", po::value<bool>(&(all.random_weights)), "make initial weights random")
     ("sparse_weights", "Use a sparse datastructure for weights")
+    ("hugepages", po::value< string >(), "Back the weights with none, transparent, 2m or 1g huge pages, falling back on smaller pages when unavailable")
+    ("numa", po::value< string >(), "Place the weights on NUMA nodes: interleave, or a node number to bind to")
     ("input_feature_regularizer", po::value< string >(&(all.per_feature_regularizer_input)), "Per feature regularization input file");
     add_options(all);
  
@@ -1207,22 +1247,52 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
       all.weights.sparse = true;
     else
       all.weights.sparse = false;
+    if (vm.count("hugepages"))
+      parse_hugepages(all.weights.memory, vm["hugepages"].as<string>());
+    if (vm.count("numa"))
+      parse_numa(all.weights.memory, vm["numa"].as<string>());
     
     new_options(all, "Parallelization options")
     ("span_server", po::value<string>(), "Location of server for setting up spanning tree")
+    ("allreduce", po::value<string>()->default_value("tree"), "How nodes reduce through the span server: tree, ring (reduce-scatter and allgather around all the nodes), or shm (in memory shared by the nodes of each host, then around a ring of the hosts)")
+    ("allreduce_host", po::value<string>(), "With --allreduce shm, nodes naming the same host share memory.  By default nodes share it with those reaching the span server from the same address")
+    ("sparse_allreduce", po::value<float>(&(all.sparse_allreduce)), "Exchange only the weights or gradients the nodes changed since they last reduced them, while at most <arg> of them changed (above 0.5 the changes outweigh the whole vector)")
+    ("allreduce_encoding", po::value<string>()->default_value("fp32"), "How nodes send the gradients bfgs sums and the weights non-adaptive gd averages: fp32, or fp16 or int8 with a scale per 256 entries, int8 rounded stochastically")
+    ("allreduce_error_feedback", "Add what --allreduce_encoding dropped from a node's vector into its next exchange")
     ("threads", "Enable multi-threading")
+    ("learner_threads", po::value<size_t>(&(all.learner_threads)), "Learn on <arg> threads updating the same weights without locks (Hogwild), for plain gd on dense weights.  Predictions are written in the order examples finish")
+    ("io_threads", po::value<size_t>(&(all.io_threads)), "in persistent daemon mode, serve all connections from one process on <arg> threads multiplexing them with epoll, rather than from children")
+    ("io_batch_size", po::value<size_t>(&(all.io_batch_size)), "with --io_threads, predict up to <arg> examples from any connections back to back before answering (default 1)")
+    ("io_batch_wait", po::value<size_t>(&(all.io_batch_wait)), "with --io_threads, wait at most <arg> microseconds for a batch to fill (default 0, batch what has arrived)")
+    ("snapshot_every", po::value<size_t>(&(all.snapshot_every)), "with --io_threads, learn on a thread of its own and answer from a copy of the model refreshed every <arg> learned examples; needed to reload the model with 'load_<file> or SIGHUP")
     ("unique_id", po::value<size_t>()->default_value(0), "unique id used for cluster parallel jobs")
     ("total", po::value<size_t>()->default_value(1), "total number of nodes used in cluster parallel job")
     ("node", po::value<size_t>()->default_value(0), "node number in cluster parallel job");
     add_options(all);
 
+    string encoding = vm["allreduce_encoding"].as<string>();
+    if (encoding == "fp16")
+      all.allreduce_encoding = QUANTIZE_FP16;
+    else if (encoding == "int8")
+      all.allreduce_encoding = QUANTIZE_INT8;
+    else if (encoding != "fp32")
+      THROW("--allreduce_encoding takes fp32, fp16 or int8, not " << encoding);
+    all.allreduce_error_feedback = vm.count("allreduce_error_feedback") > 0;
+
     if (vm.count("span_server"))
-    { all.all_reduce_type = AllReduceType::Socket;
+    { string algorithm = vm["allreduce"].as<string>();
+      if (algorithm != "tree" && algorithm != "ring" && algorithm != "shm")
+        THROW("--allreduce takes tree, ring or shm, not " << algorithm);
+      if (all.sparse_allreduce < 0.f || all.sparse_allreduce > 1.f)
+        THROW("--sparse_allreduce takes a fraction between 0 and 1, not " << all.sparse_allreduce);
+      all.all_reduce_type = AllReduceType::Socket;
       all.all_reduce = new AllReduceSockets(
         vm["span_server"].as<string>(),
         vm["unique_id"].as<size_t>(),
         vm["total"].as<size_t>(),
-        vm["node"].as<size_t>());
+        vm["node"].as<size_t>(),
+        algorithm == "ring" ? Ring : algorithm == "shm" ? SharedMemory : Tree,
+        vm.count("allreduce_host") ? vm["allreduce_host"].as<string>() : "");
     }
 
     all.random_state = all.random_seed;
@@ -1255,6 +1325,65 @@ bool check_interaction_settings_collision(vw& all)
   return opts_has_inter;
 }
 
+// Learner threads and daemon I/O threads share one copy of every reduction, so only gd under
+// the scorer, whose per-example state is on the stack, may run on them.  The statistics gd
+// keeps across examples are updated racily, like the weights.
+void check_shared_learner(vw& all, const char* option)
+{ if (all.weights.sparse)
+    THROW(option << " needs dense weights, not --sparse_weights");
+  if (all.l != all.scorer)
+    THROW(option << " only supports binary and regression learning with gd");
+  const char* stateful[] = {"ksvm", "ftrl", "pistol", "svrg", "sendto", "rank", "print", "noop", "lda", "bfgs", "conjugate_gradient",
+                            "OjaNewton", "replay_b", "active", "active_cover", "confidence", "nn", "new_mf", "marginal", "autolink",
+                            "lrq", "lrqfa", "stage_poly"
+                           };
+  for (const char* reduction : stateful)
+    if (all.vm.count(reduction))
+      THROW(option << " can not be used with --" << reduction);
+  if (all.audit || all.hash_inv)
+    THROW(option << " can not be used with --audit or --invert_hash");
+  if (all.vm.count("flat_features"))
+    THROW(option << " can not be used with --flat_features, whose buffer gd shares");
+}
+
+// A quantized model fills only the weights gd's predict reads, so nothing reading the weight
+// table itself may use one.
+void check_quantized(vw& all)
+{ if (!all.vm.count("quantized") && all.quantized_regressor_name.empty())
+    return;
+  const char* readers[] = {"lrq", "lrqfa", "stage_poly", "ksvm", "ftrl", "pistol", "svrg", "lda", "bfgs", "conjugate_gradient",
+                           "OjaNewton", "rank", "new_mf", "audit_regressor"
+                          };
+  for (const char* reduction : readers)
+    if (all.vm.count(reduction))
+      THROW("a quantized model can not be used with --" << reduction << ", which reads the weights outside gd's predict");
+}
+
+void check_threads(vw& all)
+{ if (all.learner_threads > 1)
+  { check_shared_learner(all, "--learner_threads");
+    if (!all.quiet)
+      all.trace_message << "learning on " << all.learner_threads << " threads" << endl;
+  }
+}
+
+// Runs once parse_source has told whether this is a daemon.
+void check_io_threads(vw& all)
+{ if (all.io_batch_size == 0)
+    THROW("--io_batch_size must be positive");
+  if ((all.vm.count("io_batch_size") || all.vm.count("io_batch_wait")) && all.io_threads == 0)
+    THROW("--io_batch_size and --io_batch_wait are for --io_threads");
+  if (all.vm.count("snapshot_every") && (all.io_threads == 0 || all.snapshot_every == 0))
+    THROW("--snapshot_every takes a positive number of examples and is for --io_threads");
+  if (all.io_threads > 0)
+  { if (!all.daemon || all.active)
+      THROW("--io_threads is for --daemon");
+    if (all.learner_threads > 1)
+      THROW("--io_threads and --learner_threads can not be used together");
+    check_shared_learner(all, "--io_threads");
+  }
+}
+
 void parse_modules(vw& all, io_buf& model)
 { save_load_header(all, model, true, false);
 
@@ -1295,6 +1424,10 @@ void parse_modules(vw& all, io_buf& model)
 
   parse_reductions(all);
 
+  check_quantized(all);
+
+  check_threads(all);
+
   if (!all.quiet)
   { all.trace_message << "Num weight bits = " << all.num_bits << endl;
     all.trace_message << "learning rate = " << all.eta << endl;
@@ -1311,6 +1444,8 @@ void parse_sources(vw& all, io_buf& model, bool skipModelLoad)
 
   parse_source(all);
 
+  check_io_threads(all);
+
   enable_sources(all, all.quiet, all.numpasses);
 
   // force wpp to be a power of 2 to avoid 32-bit overflow
@@ -1422,11 +1557,13 @@ vw* initialize(int argc, char* argv[], io_buf* model, bool skipModelLoad, trace_
   }
   catch (std::exception& e)
   { all.trace_message << "Error: " << e.what() << endl;
+    all.early_terminate = true; // nothing was learned, so write no model
     finish(all);
     throw;
   }
   catch (...)
-  { finish(all);
+  { all.early_terminate = true;
+    finish(all);
     throw;
   }
 }
@@ -1567,6 +1704,9 @@ void finish(vw& all, bool delete_all)
   delete all.loss;
 
   delete all.all_reduce;
+  free(all.allreduce_base);
+  for (auto& residual : all.allreduce_residuals)
+    free(residual.second);
 
   // destroy all interactions and array of them
   for (v_string& i : all.interactions) i.delete_v();
@@ -324,13 +324,13 @@ public:
     }
   }
 
-  TC_parser(char* reading_head, char* endLine, vw& all, example* ae)
+  TC_parser(char* reading_head, char* endLine, vw& all, parser* p, example* ae)
   { spelling = v_init<char>();
     if (endLine != reading_head)
     { this->beginLine = reading_head;
       this->reading_head = reading_head;
       this->endLine = endLine;
-      this->p = all.p;
+      this->p = p;
       this->redefine_some = all.redefine_some;
       this->redefine = &all.redefine;
       this->ae = ae;
@@ -346,7 +346,11 @@ public:
 };
 
 void substring_to_example(vw* all, example* ae, substring example)
-{ all->p->lp.default_label(&ae->l);
+{ substring_to_example(all, all->p, all->sd, ae, example);
+}
+
+void substring_to_example(vw* all, parser* p, shared_data* sd, example* ae, substring example)
+{ p->lp.default_label(&ae->l);
   char* bar_location = safe_index(example.begin, '|', example.end);
   char* tab_location = safe_index(example.begin, '\t', bar_location);
   substring label_space;
@@ -359,25 +363,25 @@ void substring_to_example(vw* all, example* ae, substring example)
   label_space.end = bar_location;
 
   if (*example.begin == '|')
-  { all->p->words.erase();
+  { p->words.erase();
   }
   else
-  { tokenize(' ', label_space, all->p->words);
-    if (all->p->words.size() > 0 && (all->p->words.last().end == label_space.end	|| *(all->p->words.last().begin) == '\'')) //The last field is a tag, so record and strip it off
-    { substring tag = all->p->words.pop();
+  { tokenize(' ', label_space, p->words);
+    if (p->words.size() > 0 && (p->words.last().end == label_space.end	|| *(p->words.last().begin) == '\'')) //The last field is a tag, so record and strip it off
+    { substring tag = p->words.pop();
       if (*tag.begin == '\'')
         tag.begin++;
       push_many(ae->tag, tag.begin, tag.end - tag.begin);
     }
   }
 
-  if (all->p->words.size() > 0)
-    all->p->lp.parse_label(all->p, all->sd, &ae->l, all->p->words);
+  if (p->words.size() > 0)
+    p->lp.parse_label(p, sd, &ae->l, p->words);
 
   if (all->audit || all->hash_inv)
-    TC_parser<true> parser_line(bar_location,example.end,*all,ae);
+    TC_parser<true> parser_line(bar_location,example.end,*all,p,ae);
   else
-    TC_parser<false> parser_line(bar_location,example.end,*all,ae);
+    TC_parser<false> parser_line(bar_location,example.end,*all,p,ae);
 }
 
 
@@ -16,6 +16,8 @@ typedef enum
 } FeatureInputType;
 
 void substring_to_example(vw* all, example* ae, substring example);
+// parse using the scratch space and label statistics of p and sd instead of those of all
+void substring_to_example(vw* all, parser* p, shared_data* sd, example* ae, substring example);
 
 namespace VW
 {
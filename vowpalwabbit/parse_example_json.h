@@ -28,6 +28,8 @@ using namespace std;
 using namespace rapidjson;
 
 struct vw;
+struct parser;
+struct shared_data;
 
 template<bool audit>
 struct BaseState;
@@ -244,7 +246,7 @@ public:
 		}
 		else if (found)
 		{
-			count_label(ctx.all->sd, ctx.ex->l.simple.label);
+			count_label(ctx.sd, ctx.ex->l.simple.label);
 
 			found = false;
 		}
@@ -319,7 +321,7 @@ struct LabelState : BaseState<audit>
 		// only to be used with copy=false
 		assert(!copy);
 
-		VW::parse_example_label(*ctx.all, *ctx.ex, str);
+		parse_example_label(*ctx.p, ctx.sd, *ctx.ex, str);
 		return ctx.previous_state;
 	}
 
@@ -750,6 +752,8 @@ public:
 template<bool audit>
 struct Context
 { vw* all;
+  parser* p; // scratch space for label parsing
+  shared_data* sd; // receives label statistics
   std::stringstream error;
 
   // last "<key>": encountered
@@ -792,9 +796,11 @@ struct Context
 		namespace_path.delete_v();
 	}
 
-	void init(vw* pall)
+	void init(vw* pall, parser* pp, shared_data* psd)
 	{
 		all = pall;
+		p = pp;
+		sd = psd;
 		key = " ";
 		key_length = 1;
 		previous_state = nullptr;
@@ -806,7 +812,7 @@ struct Context
 		Namespace<audit> n;
 		n.feature_group = ns[0];
 		n.namespace_hash = VW::hash_space(*all, ns);
-		n.ftrs = ex->feature_space + ns[0];
+		n.ftrs = &ex->feature_space[ns[0]];
 		n.feature_count = 0;
 		n.return_state = return_state;
 
@@ -838,9 +844,9 @@ struct VWReaderHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>,
 {
 	Context<audit> ctx;
 
-	void init(vw* all, v_array<example*>* examples, rapidjson::InsituStringStream* stream, VW::example_factory_t example_factory, void* example_factory_context)
+	void init(vw* all, parser* p, shared_data* sd, v_array<example*>* examples, rapidjson::InsituStringStream* stream, VW::example_factory_t example_factory, void* example_factory_context)
 	{
-		ctx.init(all);
+		ctx.init(all, p, sd);
 		ctx.examples = examples;
 		ctx.ex = (*examples)[0];
 		all->p->lp.default_label(&ctx.ex->l);
@@ -884,16 +890,17 @@ struct json_parser
 
 namespace VW
 {
+	// parse using the json parser and scratch space of p, collecting label statistics in sd
 	template<bool audit>
-	void read_line_json(vw& all, v_array<example*>& examples, char* line, example_factory_t example_factory, void* ex_factory_context)
+	void read_line_json(vw& all, ::parser& p, shared_data* sd, v_array<example*>& examples, char* line, example_factory_t example_factory, void* ex_factory_context)
 	{
 		// string line_copy(line);
 		// destructive parsing
 		InsituStringStream ss(line);
-		json_parser<audit>* parser = (json_parser<audit>*)all.p->jsonp;
+		json_parser<audit>* parser = (json_parser<audit>*)p.jsonp;
 
 		VWReaderHandler<audit>& handler = parser->handler;
-		handler.init(&all, &examples, &ss, example_factory, ex_factory_context);
+		handler.init(&all, &p, sd, &examples, &ss, example_factory, ex_factory_context);
 
 		ParseResult result = parser->reader.template Parse<kParseInsituFlag, InsituStringStream, VWReaderHandler<audit>>(ss, handler);
 		if (!result.IsError())
@@ -906,6 +913,12 @@ namespace VW
 			"State: " << (current_state ? current_state->name : "null")); // <<
 			// "Line: '"<< line_copy << "'");
 	}
+
+	template<bool audit>
+	void read_line_json(vw& all, v_array<example*>& examples, char* line, example_factory_t example_factory, void* ex_factory_context)
+	{
+		read_line_json<audit>(all, *all.p, all.sd, examples, line, example_factory, ex_factory_context);
+	}
 }
 
 template<bool audit>
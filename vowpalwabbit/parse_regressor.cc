@@ -51,18 +51,67 @@ public:
     }
 };
 
+void construct_weights(vw& all, dense_parameters& weights, size_t length)
+{ weight_memory& memory = all.weights.memory;
+  if (!memory.map_file.empty())
+  { mapped_trailer trailer;
+    if (!read_mapped_trailer(memory.map_file, trailer))
+      THROW(memory.map_file << " is not a mapped model");
+    if (trailer.length != length)
+      THROW(memory.map_file << " has room for " << trailer.length << " features rather than the " << length
+            << " of -b " << all.num_bits);
+    if (trailer.stride_shift == weights.stride_shift())
+    { // nothing writes the weights of a model only used to predict, unless a daemon reloads it
+      memory.map_read_only = !all.training && !all.vm.count("snapshot_every");
+      size_t mapped;
+      weight* table = (weight*)map_model_weights(memory.map_file, trailer, !memory.map_read_only, mapped);
+      new(&weights) dense_parameters(table, length, weights.stride_shift(), mapped);
+      if (!all.quiet)
+        all.trace_message << "weights: mapped " << (memory.map_read_only ? "read-only" : "copy-on-write")
+                          << " from " << memory.map_file << endl;
+      return;
+    }
+    // the table was written for other learning options, e.g. with the learning state of
+    // --save_resume but now only used to predict, so copy what the options keep of it
+    new(&weights) dense_parameters(length, weights.stride_shift(), all.weights.memory);
+    size_t mapped;
+    weight* table = (weight*)map_model_weights(memory.map_file, trailer, false, mapped);
+    size_t kept = (size_t)1 << min(trailer.stride_shift, weights.stride_shift());
+    weight* first = weights.first();
+    for (size_t i = 0; i < length; i++)
+      memcpy(first + (i << weights.stride_shift()), table + (i << trailer.stride_shift), kept * sizeof(weight));
+    free_weights(table, mapped);
+    if (!all.quiet)
+      all.trace_message << "weights: copied from " << memory.map_file << ", which has "
+                        << (1 << trailer.stride_shift) << " weights per feature rather than " << weights.stride() << endl;
+    return;
+  }
+  new(&weights) dense_parameters(length, weights.stride_shift(), all.weights.memory);
+  if (!all.quiet && all.weights.memory.requested())
+    all.trace_message << "weights: " << all.weights.memory.backing << endl;
+}
+
+void construct_weights(vw& all, sparse_parameters& weights, size_t length)
+{ if (!all.weights.memory.map_file.empty())
+    THROW("the mapped model " << all.weights.memory.map_file << " needs dense weights, not --sparse_weights");
+  new(&weights) sparse_parameters(length, weights.stride_shift()); }
+
 template<class T> void initialize_regressor(vw& all, T& weights)
 { // Regressor is already initialized.
   if (weights.not_null())
     return;
   size_t length = ((size_t)1) << all.num_bits;
   try
-    { new(&weights) T(length, weights.stride_shift()); }
+    { construct_weights(all, weights, length); }
   catch (VW::vw_exception anExc)
-    { THROW(" Failed to allocate weight array with " << all.num_bits << " bits: try decreasing -b <bits>");
+    { if (!all.weights.memory.map_file.empty())
+        throw;
+      THROW(" Failed to allocate weight array with " << all.num_bits << " bits: try decreasing -b <bits>");
     }
   if (weights.mask() == 0)
     { THROW(" Failed to allocate weight array with " << all.num_bits << " bits: try decreasing -b <bits>"); }
+  else if (!all.weights.memory.map_file.empty())
+    return; // the weights are the mapped model's
   else if (all.initial_weight != 0.)
     weights.template set_default<float,set_initial_wrapper<T> >(all.initial_weight);
   else if (all.random_positive_weights)
@@ -376,11 +425,14 @@ void save_load_header(vw& all, io_buf& model_file, bool read, bool text)
         all.file_options->str(buff2);
       }
       else
-      { msg << "options:"<< all.file_options->str() << "\n";
+      { string options = all.file_options->str();
+        if (model_file.model_weights == io_buf::QUANTIZED_WEIGHTS) // so that gd reads them back
+          options += string(" --quantized ") + quantization_name(all.quantize);
+        msg << "options:"<< options << "\n";
 
-        uint32_t len = (uint32_t)all.file_options->str().length();
+        uint32_t len = (uint32_t)options.length();
         if (len > 0)
-          safe_memcpy(buff2, buf2_size, all.file_options->str().c_str(), len + 1);
+          safe_memcpy(buff2, buf2_size, options.c_str(), len + 1);
         *(buff2 + len) = 0;
         bytes_read_write += bin_text_read_write(model_file, buff2, len + 1, //len+1 to write a \0
                                                 "", read, msg, text);
@@ -443,6 +495,61 @@ void dump_regressor(vw& all, string reg_name, bool as_text)
   rename(start_name.c_str(),reg_name.c_str());
 }
 
+// Writes the model without gd's weights, then appends the dense table for -i to map.
+void dump_mapped_regressor(vw& all, string reg_name)
+{ if (reg_name == string(""))
+    return;
+  if (all.weights.sparse)
+    THROW("--mapped_regressor needs dense weights, not --sparse_weights");
+  string start_name = reg_name+string(".writing");
+  io_buf io_temp;
+  io_temp.open_file(start_name.c_str(), all.stdin_off, io_buf::WRITE);
+
+  io_temp.model_weights = io_buf::MAPPED_WEIGHTS;
+  save_load_header(all, io_temp, false, false);
+  all.l->save_load(io_temp, false, false);
+  io_temp.flush();
+  bool left_out = io_temp.model_weights != io_buf::MAPPED_WEIGHTS;
+  if (left_out) // like the weights gd writes, the learning state only with --save_resume
+  { dense_parameters& weights = all.weights.dense_weights;
+    write_mapped_weights(io_temp.files[0], weights.first(), (weights.mask() + 1) >> weights.stride_shift(),
+                         weights.stride_shift(), all.save_resume ? weights.stride_shift() : 0);
+  }
+  io_temp.close_file();
+
+  if (!left_out)
+  { remove(start_name.c_str());
+    THROW("--mapped_regressor needs a learner that keeps its weights through gd");
+  }
+  remove(reg_name.c_str());
+  rename(start_name.c_str(),reg_name.c_str());
+}
+
+// Writes the model with gd's weights quantized to all.quantize, for prediction only.
+void dump_quantized_regressor(vw& all, string reg_name)
+{ if (reg_name == string(""))
+    return;
+  if (all.weights.sparse)
+    THROW("--quantized_regressor needs dense weights, not --sparse_weights");
+  string start_name = reg_name+string(".writing");
+  io_buf io_temp;
+  io_temp.open_file(start_name.c_str(), all.stdin_off, io_buf::WRITE);
+
+  io_temp.model_weights = io_buf::QUANTIZED_WEIGHTS;
+  save_load_header(all, io_temp, false, false);
+  all.l->save_load(io_temp, false, false);
+  bool quantized = io_temp.model_weights != io_buf::QUANTIZED_WEIGHTS;
+  io_temp.flush();
+  io_temp.close_file();
+
+  if (!quantized)
+  { remove(start_name.c_str());
+    THROW("--quantized_regressor needs a learner that keeps its weights through gd");
+  }
+  remove(reg_name.c_str());
+  rename(start_name.c_str(),reg_name.c_str());
+}
+
 void save_predictor(vw& all, string reg_name, size_t current_pass)
 { stringstream filename;
   filename << reg_name;
@@ -457,6 +564,8 @@ void finalize_regressor(vw& all, string reg_name)
       dump_regressor(all, all.per_feature_regularizer_output, false);
     else
       dump_regressor(all, reg_name, false);
+    dump_mapped_regressor(all, all.mapped_regressor_name);
+    dump_quantized_regressor(all, all.quantized_regressor_name);
     if (all.per_feature_regularizer_text.length() > 0)
       dump_regressor(all, all.per_feature_regularizer_text, true);
     else
@@ -477,6 +586,14 @@ void parse_regressor_args(vw& all, io_buf& io_temp)
   if (vm.count("input_feature_regularizer"))
     regs.push_back(vm["input_feature_regularizer"].as<string>());
 
+  mapped_trailer trailer;
+  if (regs.size() > 0 && read_mapped_trailer(regs[0], trailer))
+  { if (vm.count("feature_mask") || vm.count("input_feature_regularizer"))
+      THROW("the mapped model " << regs[0] << " can not be used with --feature_mask or --input_feature_regularizer");
+    all.weights.memory.map_file = regs[0];
+    io_temp.model_weights = io_buf::MAPPED_WEIGHTS;
+  }
+
   if (regs.size() > 0)
   { io_temp.open_file(regs[0].c_str(), all.stdin_off, io_buf::READ);
     if (!all.quiet)
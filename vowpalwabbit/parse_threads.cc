@@ -0,0 +1,385 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <algorithm>
+
+#include "parse_threads.h"
+#include "parse_example.h"
+#include "parse_example_json.h"
+#include "unique_sort.h"
+#include "best_constant.h"
+#include "cache.h"
+#include "vw.h"
+
+using namespace std;
+
+enum chunk_input { TEXT_LINES, JSON_LINES, CACHE_BLOCK };
+
+// A run of consecutive input lines or cached examples, and the examples parsed from it.  Chunks
+// and their examples are recycled, so the feature arrays keep their capacity from chunk to chunk.
+struct parse_chunk
+{ uint64_t first_example; // input position of the first line, for parser warnings
+  v_array<char> text;      // the lines, each followed by one terminating character
+  v_array<size_t> lines;   // offset of each line in text
+  io_buf records;          // a run of examples from a cache block
+  size_t block_examples;   // examples to decode from records
+  unsigned char codec;     // of the block cache, records then hold a whole compressed block
+  io_buf unpacked;
+  v_array<example*> pool;  // examples owned by the chunk
+  size_t used;             // examples of pool filled by the last parse
+  chunk_input input;
+  bool setup_features;     // run setup_example_features on the parse thread rather than the dispatcher
+  shared_data sd;          // label statistics seen while parsing this chunk
+  exception_ptr error;
+  bool parsed;
+};
+
+struct parse_pool
+{ vw* all;
+  vector<thread> threads;
+  mutex lock;
+  condition_variable work_available;
+  condition_variable chunk_parsed;
+  deque<parse_chunk*> todo;      // dispatched chunks no thread has picked up yet
+  deque<parse_chunk*> in_flight; // dispatched chunks not yet handed to the learner, in input order
+  v_array<parse_chunk*> spare;
+  size_t max_in_flight;
+  bool stop;
+};
+
+example& next_example(parse_chunk& c)
+{ if (c.used == c.pool.size())
+    c.pool.push_back(VW::alloc_examples(0, 1));
+  return *c.pool[c.used++];
+}
+
+example& next_chunk_example(void* c) { return next_example(*(parse_chunk*)c); }
+
+template<bool audit>
+void parse_json_line(vw& all, parser& p, parse_chunk& c, v_array<example*>& examples, char* line)
+{ if (p.jsonp == nullptr)
+    p.jsonp = new json_parser<audit>;
+  examples.erase();
+  examples.push_back(&next_example(c));
+  VW::read_line_json<audit>(all, p, &c.sd, examples, line, &next_chunk_example, &c);
+
+  // multiline json is terminated by an empty example, as in read_features_json
+  if (examples.size() > 1)
+  { char empty = '\0';
+    substring ss = { &empty, &empty };
+    substring_to_example(&all, &p, &c.sd, &next_example(c), ss);
+  }
+}
+
+void parse_chunk_examples(vw& all, parser& p, v_array<example*>& examples, parse_chunk& c)
+{ c.used = 0;
+  if (c.input == CACHE_BLOCK)
+  { io_buf& records = unpack_cache_records(c.codec, c.records, c.unpacked);
+    for (size_t i = 0; i < c.block_examples; i++)
+      if (read_cached_example(&all, &c.sd, records, &next_example(c)) == 0)
+        THROW("truncated example in block cache");
+  }
+  else
+    for (size_t i = 0; i < c.lines.size(); i++)
+    { p.end_parsed_examples = c.first_example + i;
+      char* line = c.text.begin() + c.lines[i];
+      if (c.input == TEXT_LINES)
+      { size_t end = (i + 1 < c.lines.size() ? c.lines[i + 1] : c.text.size()) - 1;
+        substring ss = { line, c.text.begin() + end };
+        substring_to_example(&all, &p, &c.sd, &next_example(c), ss);
+      }
+      else if (all.audit)
+        parse_json_line<true>(all, p, c, examples, line);
+      else
+        parse_json_line<false>(all, p, c, examples, line);
+    }
+
+  for (size_t i = 0; i < c.used; i++)
+  { example* ae = c.pool[i];
+    if (all.p->sort_features && ae->sorted == false)
+      unique_sort_features(all.parse_mask, ae);
+    if (c.setup_features)
+      setup_example_features(all, p, ae);
+  }
+}
+
+void parse_thread(parse_pool* pool)
+{ vw& all = *pool->all;
+  // private scratch space for tokenizing, label parsing and ngrams
+  parser& p = calloc_or_throw<parser>();
+  p.hasher = all.p->hasher;
+  p.lp = all.p->lp;
+  v_array<example*> examples = v_init<example*>();
+
+  while (true)
+  { parse_chunk* c;
+    { unique_lock<mutex> l(pool->lock);
+      pool->work_available.wait(l, [pool] { return pool->stop || !pool->todo.empty(); });
+      if (pool->stop)
+        break;
+      c = pool->todo.front();
+      pool->todo.pop_front();
+    }
+
+    try
+    { parse_chunk_examples(all, p, examples, *c);
+    }
+    catch (...)
+    { c->error = current_exception();
+    }
+
+    { lock_guard<mutex> l(pool->lock);
+      c->parsed = true;
+    }
+    pool->chunk_parsed.notify_all();
+  }
+
+  examples.delete_v();
+  p.words.delete_v();
+  p.channels.delete_v();
+  p.name.delete_v();
+  p.parse_name.delete_v();
+  p.gram_mask.delete_v();
+  if (p.jsonp != nullptr)
+  { if (all.audit)
+      delete (json_parser<true>*)p.jsonp;
+    else
+      delete (json_parser<false>*)p.jsonp;
+  }
+  free(&p);
+}
+
+void start_parse_threads(vw& all)
+{ const char* reason = nullptr;
+  if (all.daemon || all.active)
+    reason = "input from a socket is parsed on the parse thread";
+  else if (all.sd->ldict != nullptr)
+    reason = "named labels are looked up in a table that is not thread safe";
+  else
+    for (size_t i = 0; i < 256; i++)
+      if (all.namespace_dictionaries[i].size() > 0)
+        reason = "feature dictionaries are looked up in a table that is not thread safe";
+  if (reason != nullptr)
+  { all.trace_message << "warning: ignoring --parse_threads, " << reason << endl;
+    return;
+  }
+
+  parse_pool* pool = new parse_pool;
+  pool->all = &all;
+  pool->spare = v_init<parse_chunk*>();
+  pool->max_in_flight = 2 * all.p->parse_threads;
+  pool->stop = false;
+  all.p->pool = pool;
+  for (size_t i = 0; i < all.p->parse_threads; i++)
+    pool->threads.push_back(thread(parse_thread, pool));
+}
+
+void free_chunk(vw& all, parse_chunk* c)
+{ c->text.delete_v();
+  c->lines.delete_v();
+  for (example* ae : c->pool)
+  { VW::dealloc_example(all.p->lp.delete_label, *ae);
+    free(ae);
+  }
+  c->pool.delete_v();
+  delete c;
+}
+
+void end_parse_threads(vw& all)
+{ parse_pool* pool = all.p->pool;
+  { lock_guard<mutex> l(pool->lock);
+    pool->stop = true;
+  }
+  pool->work_available.notify_all();
+  for (thread& t : pool->threads)
+    t.join();
+
+  for (parse_chunk* c : pool->in_flight)
+    free_chunk(all, c);
+  for (parse_chunk* c : pool->spare)
+    free_chunk(all, c);
+  pool->spare.delete_v();
+  delete pool;
+  all.p->pool = nullptr;
+}
+
+// Read up to max_lines lines of input, or a run of examples from a block cache, into a chunk.
+// Without ordering, a chunk of text is extended to the next empty line so that a multiline
+// example never spans two chunks; a block longer than the ring can not be learned as one
+// example anyway, which bounds the extension.
+parse_chunk* read_chunk(vw& all, parse_pool& pool, chunk_input input, size_t max_lines)
+{ parser& p = *all.p;
+  parse_chunk* c;
+  if (pool.spare.size() > 0)
+    c = pool.spare.pop();
+  else
+  { c = new parse_chunk;
+    c->text = v_init<char>();
+    c->lines = v_init<size_t>();
+    c->pool = v_init<example*>();
+    c->used = 0;
+    memcpy(&c->sd, all.sd, sizeof(shared_data));
+  }
+  c->text.erase();
+  c->lines.erase();
+  c->block_examples = 0;
+
+  size_t wanted = min(max_lines, p.parse_chunk_size);
+  size_t extended = (p.parse_unordered && input == TEXT_LINES) ? min(max_lines, p.parse_chunk_size + p.ring_size) : wanted;
+  if (input == CACHE_BLOCK)
+  { c->block_examples = read_cache_records(p, c->records, p.parse_chunk_size, max_lines);
+    c->codec = block_cache_codec(p);
+  }
+  else
+    while (c->lines.size() < extended)
+    { char* line;
+      size_t num_chars;
+      size_t num_chars_initial = read_features(&all, line, num_chars);
+      if (num_chars_initial < 1)
+        break;
+      c->lines.push_back(c->text.size());
+      push_many(c->text, line, num_chars);
+      // keep the line terminator for text, parseFloat takes its fast path on '\n'
+      c->text.push_back(input == TEXT_LINES && num_chars < num_chars_initial ? line[num_chars] : '\0');
+      if (c->lines.size() >= wanted && num_chars == 0)
+        break;
+    }
+
+  if (c->lines.size() == 0 && c->block_examples == 0)
+  { pool.spare.push_back(c);
+    return nullptr;
+  }
+
+  c->input = input;
+  c->setup_features = !p.write_cache;
+  c->sd.is_more_than_two_labels_observed = false;
+  c->sd.first_observed_label = FLT_MAX;
+  c->sd.second_observed_label = FLT_MAX;
+  c->error = nullptr;
+  c->parsed = false;
+  return c;
+}
+
+// Wait for the oldest chunk in flight (or, without ordering, any finished chunk) and take it out of flight.
+parse_chunk* next_parsed_chunk(parse_pool& pool, bool ordered)
+{ unique_lock<mutex> l(pool.lock);
+  if (pool.in_flight.empty())
+    return nullptr;
+
+  deque<parse_chunk*>::iterator it;
+  pool.chunk_parsed.wait(l, [&pool, &it, ordered]
+  { it = ordered ? (pool.in_flight.front()->parsed ? pool.in_flight.begin() : pool.in_flight.end())
+         : find_if(pool.in_flight.begin(), pool.in_flight.end(), [](parse_chunk* c) { return c->parsed; });
+    return it != pool.in_flight.end();
+  });
+  parse_chunk* c = *it;
+  pool.in_flight.erase(it);
+  return c;
+}
+
+// Move the parsed contents of src into the emptied ring example dst, leaving src empty.
+void move_parsed_example(example& src, example& dst)
+{ for (namespace_index ns : src.indices)
+    swap(src.feature_space[ns], dst.feature_space[ns]);
+  swap(src.indices, dst.indices);
+  swap(src.tag, dst.tag);
+  swap(src.l, dst.l);
+  dst.sorted = src.sorted;
+  src.sorted = false;
+  dst.weight = src.weight;
+  dst.num_features = src.num_features;
+  dst.total_sum_feat_sq = src.total_sum_feat_sq;
+  dst.partial_prediction = 0.;
+  dst.loss = 0.;
+}
+
+size_t publish_chunk(vw& all, parse_chunk& c)
+{ if (c.error != nullptr)
+    rethrow_exception(c.error);
+
+  parser& p = *all.p;
+  for (size_t i = 0; i < c.used; i++)
+  { example& ec = VW::get_unused_example(&all);
+    move_parsed_example(*c.pool[i], ec);
+    if (p.write_cache)
+      cache_example(all, &ec);
+    setup_example_position(all, &ec);
+    if (!c.setup_features)
+      setup_example_features(all, p, &ec);
+    publish_examples(p, 1);
+  }
+
+  if (c.sd.is_more_than_two_labels_observed)
+    all.sd->is_more_than_two_labels_observed = true;
+  if (c.sd.first_observed_label != FLT_MAX)
+    count_label(all.sd, c.sd.first_observed_label);
+  if (c.sd.second_observed_label != FLT_MAX)
+    count_label(all.sd, c.sd.second_observed_label);
+
+  return c.used;
+}
+
+// published examples were moved out already, anything else is discarded
+void recycle_chunk(vw& all, parse_pool& pool, parse_chunk* c)
+{ for (size_t i = 0; i < c->used; i++)
+    VW::empty_example(all, *c->pool[i]);
+  pool.spare.push_back(c);
+}
+
+size_t parse_on_threads(vw& all, size_t example_number)
+{ parse_pool& pool = *all.p->pool;
+  chunk_input input;
+  if (all.p->reader == read_features_string)
+    input = TEXT_LINES;
+  else if (all.p->reader == read_features_json<true> || all.p->reader == read_features_json<false>)
+    input = JSON_LINES;
+  else if (all.p->reader == read_cached_features && all.p->block_cache)
+    input = CACHE_BLOCK;
+  else
+    return 0;
+
+  bool ordered = !all.p->parse_unordered;
+  size_t limit = min(all.pass_length, all.max_examples);
+  size_t dispatched = example_number;
+  bool more_input = true;
+  size_t published = 0;
+  while (true)
+  { bool stop = parser_done(*all.p) || all.do_reset_source;
+    if (!stop && more_input && dispatched < limit && pool.in_flight.size() < pool.max_in_flight)
+    { parse_chunk* c = read_chunk(all, pool, input, limit - dispatched);
+      if (c == nullptr)
+        more_input = false;
+      else
+      { c->first_example = all.p->end_parsed_examples + (dispatched - example_number) - published;
+        dispatched += c->input == CACHE_BLOCK ? c->block_examples : c->lines.size();
+        { lock_guard<mutex> l(pool.lock);
+          pool.todo.push_back(c);
+          pool.in_flight.push_back(c);
+        }
+        pool.work_available.notify_one();
+      }
+      continue;
+    }
+
+    parse_chunk* c = next_parsed_chunk(pool, ordered);
+    if (c == nullptr)
+      break;
+    try
+    { if (!stop)
+        published += publish_chunk(all, *c);
+    }
+    catch (...)
+    { recycle_chunk(all, pool, c);
+      throw;
+    }
+    recycle_chunk(all, pool, c);
+  }
+  return published;
+}
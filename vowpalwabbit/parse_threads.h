@@ -0,0 +1,22 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+
+struct vw;
+
+// --parse_threads: the parse thread reads text or json lines, or blocks of a block cache,
+// into chunks, a pool of threads tokenizes and hashes or decodes them, and the parse thread
+// hands the finished examples to the learner in input order (or in completion order with
+// --parse_unordered).
+void start_parse_threads(vw& all);
+void end_parse_threads(vw& all);
+
+// Called on the parse thread.  Parses the current input on the pool until it is exhausted,
+// the pass or example limit is reached, or the parser is done, and returns the number of
+// examples handed to the learner.  Returns 0 straight away for input the pool can not
+// parse (stream caches, daemon sockets).
+size_t parse_on_threads(vw& all, size_t example_number);
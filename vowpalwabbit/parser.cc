@@ -41,6 +41,8 @@ int getpid()
 #include <errno.h>
 #include <stdio.h>
 #include <assert.h>
+#include <atomic>
+#include <thread>
 namespace po = boost::program_options;
 
 #include "parse_example.h"
@@ -51,6 +53,8 @@ namespace po = boost::program_options;
 #include "interactions.h"
 #include "vw_exception.h"
 #include "parse_example_json.h"
+#include "parse_threads.h"
+#include "example_pool.h"
 
 using namespace std;
 
@@ -125,6 +129,68 @@ void condition_variable_signal_all(CV * pcv)
 #endif
 }
 
+// The parser thread produces into the example ring and the learner consumes from it.
+// Ownership of a slot and the count of published examples are tracked with atomics so
+// that handing over an example costs a couple of atomic operations.  The mutex and
+// condition variables in parser are only touched by a thread that has to block, and
+// by the other side when it sees a registered waiter.
+struct ring_sync
+{ std::atomic<uint64_t> end_parsed_examples; // examples visible to get_example
+  std::atomic<uint64_t> finished_examples;   // examples returned by finish_example
+  std::atomic<bool> done;
+  std::atomic<bool>* busy;                   // one flag per ring slot, set while the slot holds an example
+  std::atomic<uint32_t> unused_waiters;      // threads blocked on example_unused
+  std::atomic<uint32_t> available_waiters;   // threads blocked on example_available
+  std::atomic<uint32_t> output_waiters;      // threads blocked on output_done
+};
+
+// Poll ready() up to spin times, yielding the cpu after a short burst, then block on cv.
+// A waiter registers itself before its final check, and a notifier checks for waiters
+// after publishing, so at least one of them sees the other and no wakeup is lost.
+template<class P> void wait_until(size_t spin, MUTEX& m, CV& cv, std::atomic<uint32_t>& waiters, P ready)
+{ for (size_t i = 0; i < spin; i++)
+  { if (ready())
+      return;
+    if (i >= 64)
+      std::this_thread::yield();
+  }
+  if (ready())
+    return;
+
+  mutex_lock(&m);
+  waiters.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (!ready())
+    condition_variable_wait(&cv, &m);
+  waiters.fetch_sub(1);
+  mutex_unlock(&m);
+}
+
+void notify_waiters(MUTEX& m, CV& cv, std::atomic<uint32_t>& waiters)
+{ std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiters.load() == 0)
+    return;
+  mutex_lock(&m);
+  condition_variable_signal_all(&cv);
+  mutex_unlock(&m);
+}
+
+void publish_examples(parser& p, uint64_t count)
+{ p.end_parsed_examples += count;
+  p.sync->end_parsed_examples.store(p.end_parsed_examples, std::memory_order_release);
+  notify_waiters(p.examples_lock, p.example_available, p.sync->available_waiters);
+}
+
+bool parser_done(parser& p)
+{ return p.sync->done.load();
+}
+
+void set_parser_done(parser& p)
+{ p.sync->done.store(true);
+  notify_waiters(p.examples_lock, p.example_available, p.sync->available_waiters);
+  notify_waiters(p.examples_lock, p.example_unused, p.sync->unused_waiters);
+}
+
 //This should not? matter in a library mode.
 bool got_sigterm;
 
@@ -144,12 +210,25 @@ parser* new_parser()
 { parser& ret = calloc_or_throw<parser>();
   ret.input = new io_buf;
   ret.output = new io_buf;
-  ret.local_example_number = 0;
   ret.in_pass_counter = 0;
   ret.ring_size = 1 << 8;
-  ret.done = false;
+  ret.ring_spin = 0;
   ret.used_index = 0;
+  ret.sync = new ring_sync;
+  ret.sync->busy = nullptr;
+  ret.parse_threads = 1;
+  ret.parse_chunk_size = 64;
+  ret.parse_unordered = false;
+  ret.pool = nullptr;
+  ret.spare = create_example_pool();
   ret.jsonp = nullptr;
+  ret.cache_block_size = 0;
+  ret.cache_codec = 0;
+  ret.block_out = nullptr;
+  ret.block_cache = false;
+  ret.block_in = nullptr;
+  ret.cache_shard = 0;
+  ret.cache_shards = 1;
 
   return &ret;
 }
@@ -160,8 +239,9 @@ void set_compressed(parser* par)
   par->output = new comp_io_buf;
 }
 
-uint32_t cache_numbits(io_buf* buf, int filepointer)
-{ v_array<char> t = v_init<char>();
+uint32_t cache_numbits(io_buf* buf, int filepointer, bool& blocks)
+{ blocks = false;
+ v_array<char> t = v_init<char>();
 
   try
   { size_t v_length;
@@ -188,8 +268,9 @@ uint32_t cache_numbits(io_buf* buf, int filepointer)
     if (buf->read_file(filepointer, &temp, 1) < 1)
       THROW("failed to read");
 
-    if (temp != 'c')
+    if (temp != 'c' && temp != 'b')
       THROW("data file is not a cache file");
+    blocks = temp == 'b';
   }
   catch(...)
   { t.delete_v();
@@ -216,7 +297,9 @@ void reset_source(vw& all, size_t numbits)
 { io_buf* input = all.p->input;
   input->current = 0;
   if (all.p->write_cache)
-  { all.p->output->flush();
+  { if (all.p->block_out != nullptr)
+      finish_block_cache(*all.p);
+    all.p->output->flush();
     all.p->write_cache = false;
     all.p->output->close_file();
     remove(all.p->output->finalname.begin());
@@ -230,15 +313,15 @@ void reset_source(vw& all, size_t numbits)
           io_buf::close_file_or_socket(fd);
       }
     input->open_file(all.p->output->finalname.begin(), all.stdin_off, io_buf::READ); //pushing is merged into open_file
+    input->map_files = true;
     all.p->reader = read_cached_features;
   }
   if ( all.p->resettable == true )
   { if (all.daemon)
     { // wait for all predictions to be sent back to client
-      mutex_lock(&all.p->output_lock);
-      while (all.p->local_example_number != all.p->end_parsed_examples)
-        condition_variable_wait(&all.p->output_done, &all.p->output_lock);
-      mutex_unlock(&all.p->output_lock);
+      parser& p = *all.p;
+      wait_until(p.ring_spin, p.output_lock, p.output_done, p.sync->output_waiters,
+                 [&p] { return p.sync->finished_examples.load(std::memory_order_acquire) == p.end_parsed_examples; });
 
       // close socket, erase final prediction sink and socket
       io_buf::close_file_or_socket(all.p->input->files[0]);
@@ -268,8 +351,13 @@ void reset_source(vw& all, size_t numbits)
     else
     { for (size_t i = 0; i < input->files.size(); i++)
       { input->reset_file(input->files[i]);
-        if (cache_numbits(input, input->files[i]) < numbits)
+        bool blocks;
+        if (cache_numbits(input, input->files[i], blocks) < numbits)
           THROW("argh, a bug in caching of some sort!");
+        if (i > 0 && blocks != all.p->block_cache)
+          THROW("cache files mix the stream and block formats");
+        all.p->block_cache = blocks;
+        reset_block_cache(*all.p, input->files[i]);
       }
     }
   }
@@ -313,8 +401,12 @@ void make_write_cache(vw& all, string &newname, bool quiet)
 
   output->write_file(f, &v_length, sizeof(v_length));
   output->write_file(f,version.to_string().c_str(),v_length);
-  output->write_file(f,"c",1);
+  output->write_file(f, all.p->cache_block_size > 0 ? "b" : "c", 1);
   output->write_file(f, &all.num_bits, sizeof(all.num_bits));
+  if (all.p->cache_block_size > 0)
+  { output->write_file(f, &all.p->cache_codec, 1);
+    start_block_cache(*all.p, sizeof(v_length) + v_length + 1 + sizeof(all.num_bits) + 1);
+  }
 
   push_many(output->finalname,newname.c_str(),newname.length()+1);
   all.p->write_cache = true;
@@ -331,6 +423,8 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
     caches.push_back(source+string(".cache"));
 
   all.p->write_cache = false;
+  if (all.p->cache_shards > 1 && caches.size() > 1)
+    THROW("--cache_shards splits a single cache file");
 
   for (size_t i = 0; i < caches.size(); i++)
   { int f = -1;
@@ -342,7 +436,8 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
     if (f == -1)
       make_write_cache(all, caches[i], quiet);
     else
-    { uint64_t c = cache_numbits(all.p->input, f);
+    { bool blocks;
+      uint64_t c = cache_numbits(all.p->input, f, blocks);
       if (c < all.num_bits)
       { if (!quiet)
 		  all.trace_message << "WARNING: cache file is ignored as it's made with less bit precision than required!" << endl;
@@ -352,6 +447,11 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
       else
       { if (!quiet)
           all.trace_message << "using cache_file = " << caches[i].c_str() << endl;
+        if (all.p->reader == read_cached_features && blocks != all.p->block_cache)
+          THROW("cache files mix the stream and block formats");
+        all.p->block_cache = blocks;
+        reset_block_cache(*all.p, f);
+        all.p->input->map_files = true;
         all.p->reader = read_cached_features;
         if (c == all.num_bits)
           all.p->sorted_cache = true;
@@ -415,8 +515,8 @@ void enable_sources(vw& all, bool quiet, size_t passes)
     if ( ::bind(all.p->bound_sock,(sockaddr*)&address, sizeof(address)) < 0 )
       THROWERRNO("bind");
 
-    // listen on socket
-    if (listen(all.p->bound_sock, 1) < 0)
+    // listen on socket, with room for many clients connecting at once when they are multiplexed
+    if (listen(all.p->bound_sock, all.io_threads > 0 ? SOMAXCONN : 1) < 0)
       THROWERRNO("listen");
 
     // write port file
@@ -452,14 +552,23 @@ void enable_sources(vw& all, bool quiet, size_t passes)
       pid_file.close();
     }
 
+    if (all.io_threads > 0)
+    { // connections are accepted and served in this process, see serve_connections
+      all.p->resettable = true;
+      return;
+    }
+
     if (all.daemon && !all.active)
     {
 #ifdef _WIN32
       THROW("not supported on windows");
 #else
       fclose(stdin);
-      // weights will be shared across processes, accessible to children
-      all.weights.share(all.length());
+      // weights will be shared across processes, accessible to children.  Those of a model
+      // that only predicts are never written, so the children can keep the pages they inherit,
+      // whether mapped from a model file or left unused by a quantized model.
+      if (all.training)
+        all.weights.share(all.length());
 
       // learning state to be shared across children
       shared_data* sd = (shared_data *)mmap(0,sizeof(shared_data),
@@ -605,9 +714,7 @@ child:
 
 void set_done(vw& all)
 { all.early_terminate = true;
-  mutex_lock(&all.p->examples_lock);
-  all.p->done = true;
-  mutex_unlock(&all.p->examples_lock);
+  set_parser_done(*all.p);
 }
 
 void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
@@ -650,14 +757,14 @@ void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
  * Hash is evaluated using the principle h(a, b) = h(a)*X + h(b), where X is a random no.
  * 32 random nos. are maintained in an array and are used in the hashing.
  */
-void generateGrams(vw& all, example* &ex)
+void generateGrams(vw& all, v_array<size_t>& gram_mask, example* &ex)
 { for(namespace_index index : ex->indices)
   { size_t length = ex->feature_space[index].size();
     for (size_t n = 1; n < all.ngram[index]; n++)
-    { all.p->gram_mask.erase();
-      all.p->gram_mask.push_back((size_t)0);
+    { gram_mask.erase();
+      gram_mask.push_back((size_t)0);
       addgrams(all, n, all.skips[index], ex->feature_space[index],
-               length, all.p->gram_mask, 0);
+               length, gram_mask, 0);
     }
   }
 }
@@ -680,19 +787,15 @@ void feature_limit(vw& all, example* ex)
 namespace VW
 {
 example& get_unused_example(vw* all)
-{ parser* p = all->p;
-  while (true)
-  { mutex_lock(&p->examples_lock);
-    if (p->examples[p->begin_parsed_examples % p->ring_size].in_use == false)
-    { example& ret = p->examples[p->begin_parsed_examples++ % p->ring_size];
-      ret.in_use = true;
-      mutex_unlock(&p->examples_lock);
-      return ret;
-    }
-    else
-      condition_variable_wait(&p->example_unused, &p->examples_lock);
-    mutex_unlock(&p->examples_lock);
-  }
+{ parser& p = *all->p;
+  size_t slot = p.begin_parsed_examples++ % p.ring_size;
+  std::atomic<bool>& busy = p.sync->busy[slot];
+  wait_until(p.ring_spin, p.examples_lock, p.example_unused, p.sync->unused_waiters,
+             [&busy] { return !busy.load(std::memory_order_acquire); });
+  busy.store(true, std::memory_order_relaxed);
+  example& ret = p.examples[slot];
+  ret.in_use = true;
+  return ret;
 }
 
 void setup_examples(vw& all, v_array<example*>& examples)
@@ -705,16 +808,15 @@ void setup_example(vw& all, example* ae)
     unique_sort_features(all.parse_mask, ae);
 
   if (all.p->write_cache)
-  { all.p->lp.cache_label(&ae->l, *(all.p->output));
-    cache_features(*(all.p->output), ae, all.parse_mask);
-  }
+    cache_example(all, ae);
 
-  ae->partial_prediction = 0.;
-  ae->num_features = 0;
-  ae->total_sum_feat_sq = 0;
-  ae->loss = 0.;
+  setup_example_position(all, ae);
+  setup_example_features(all, *all.p, ae);
+}
+}
 
-  ae->example_counter = (size_t)(all.p->end_parsed_examples);
+void setup_example_position(vw& all, example* ae)
+{ ae->example_counter = (size_t)(all.p->end_parsed_examples);
   if (!all.p->emptylines_separate_examples)
     all.p->in_pass_counter++;
 
@@ -722,8 +824,15 @@ void setup_example(vw& all, example* ae)
 
   if (all.p->emptylines_separate_examples && example_is_newline(*ae))
     all.p->in_pass_counter++;
+}
 
-  ae->weight = all.p->lp.get_weight(&ae->l);
+void setup_example_features(vw& all, parser& p, example* ae)
+{ ae->partial_prediction = 0.;
+  ae->num_features = 0;
+  ae->total_sum_feat_sq = 0;
+  ae->loss = 0.;
+
+  ae->weight = p.lp.get_weight(&ae->l);
 
   if (all.ignore_some)
     for (unsigned char* i = ae->indices.begin(); i != ae->indices.end(); i++)
@@ -736,7 +845,7 @@ void setup_example(vw& all, example* ae)
       }
 
   if(all.ngram_strings.size() > 0)
-    generateGrams(all, ae);
+    generateGrams(all, p.gram_mask, ae);
 
   if (all.add_constant)//add constant feature
     VW::add_constant_feature(all,ae);
@@ -763,19 +872,17 @@ void setup_example(vw& all, example* ae)
   ae->num_features += new_features_cnt;
   ae->total_sum_feat_sq += new_features_sum_feat_sq;
 }
-}
 
 namespace VW
 {
 example* new_unused_example(vw& all)
-{ example* ec = &get_unused_example(&all);
+{ example* ec = pool_example(*all.p->spare);
   all.p->lp.default_label(&ec->l);
-  all.p->begin_parsed_examples++;
-  ec->example_counter = (size_t)all.p->begin_parsed_examples;
+  ec->example_counter = (size_t)all.p->end_parsed_examples;
   return ec;
 }
 example* read_example(vw& all, char* example_line)
-{ example* ret = &get_unused_example(&all);
+{ example* ret = pool_example(*all.p->spare);
 
   VW::read_line(all, ret, example_line);
   setup_example(all, ret);
@@ -801,7 +908,7 @@ void add_label(example* ec, float label, float weight, float base)
 }
 
 example* import_example(vw& all, string label, primitive_feature_space* features, size_t len)
-{ example* ret = &get_unused_example(&all);
+{ example* ret = pool_example(*all.p->spare);
   all.p->lp.default_label(&ret->l);
 
   if (label.length() > 0)
@@ -849,15 +956,23 @@ void releaseFeatureSpace(primitive_feature_space* features, size_t len)
 }
 
 void parse_example_label(vw& all, example&ec, string label)
+{ ::parse_example_label(*all.p, all.sd, ec, label);
+}
+
+}
+
+void parse_example_label(parser& p, shared_data* sd, example& ec, string label)
 { v_array<substring> words = v_init<substring>();
   char* cstr = (char*)label.c_str();
   substring str = { cstr, cstr+label.length() };
   tokenize(' ', str, words);
-  all.p->lp.parse_label(all.p, all.sd, &ec.l, words);
+  p.lp.parse_label(&p, sd, &ec.l, words);
   words.erase();
   words.delete_v();
 }
 
+namespace VW
+{
 void empty_example(vw& all, example& ec)
 { for (features& fs : ec)
     fs.erase();
@@ -869,24 +984,26 @@ void empty_example(vw& all, example& ec)
 }
 
 void finish_example(vw& all, example* ec)
-{ // only return examples to the pool that are from the pool and not externally allocated
-  if (!is_ring_example(all, ec))
+{ // only return examples to the ring or pool they are from, not externally allocated ones
+  bool ring = is_ring_example(all, ec);
+  if (!ring && !is_pooled_example(all, ec))
     return;
+  parser& p = *all.p;
 
-  mutex_lock(&all.p->output_lock);
-  all.p->local_example_number++;
-  condition_variable_signal(&all.p->output_done);
-  mutex_unlock(&all.p->output_lock);
+  p.sync->finished_examples.fetch_add(1, std::memory_order_release);
+  notify_waiters(p.output_lock, p.output_done, p.sync->output_waiters);
+
+  if (!ring)
+  { return_to_pool(*p.spare, ec);
+    return;
+  }
 
   empty_example(all, *ec);
 
-  mutex_lock(&all.p->examples_lock);
   assert(ec->in_use);
   ec->in_use = false;
-  condition_variable_signal(&all.p->example_unused);
-  if (all.p->done)
-    condition_variable_signal_all(&all.p->example_available);
-  mutex_unlock(&all.p->examples_lock);
+  p.sync->busy[ec - p.examples].store(false, std::memory_order_release);
+  notify_waiters(p.examples_lock, p.example_unused, p.sync->unused_waiters);
 }
 }
 
@@ -901,8 +1018,15 @@ void *main_parse_loop(void *in)
 
   try {
     size_t examples_available;
-    while(!all->p->done)
-    { examples.push_back(&VW::get_unused_example(all)); // need at least 1 example
+    while(!all->p->sync->done.load())
+    { bool finished = false;
+      if (all->p->pool != nullptr && !all->do_reset_source)
+      { // hands text or json input to the parse threads until it runs out or a limit is hit
+        example_number += parse_on_threads(*all, example_number);
+        if (all->p->sync->done.load())
+          break;
+      }
+      examples.push_back(&VW::get_unused_example(all)); // need at least 1 example
       if (!all->do_reset_source && example_number != all->pass_length && all->max_examples > example_number
           && all->p->reader(all, examples) > 0)
       { VW::setup_examples(*all, examples);
@@ -920,17 +1044,14 @@ void *main_parse_loop(void *in)
           all->pass_length = all->pass_length*2+1;
         }
         if (all->passes_complete >= all->numpasses && all->max_examples >= example_number)
-        { mutex_lock(&all->p->examples_lock);
-          all->p->done = true;
-          mutex_unlock(&all->p->examples_lock);
-        }
+          finished = true;
         example_number = 0;
         examples_available=1;
       }
-      mutex_lock(&all->p->examples_lock);
-      all->p->end_parsed_examples+=examples_available;
-      condition_variable_signal_all(&all->p->example_available);
-      mutex_unlock(&all->p->examples_lock);
+      // publish before signalling done so the learner never sees done with examples outstanding
+      publish_examples(*all->p, examples_available);
+      if (finished)
+        set_parser_done(*all->p);
       examples.erase();
     }
   }
@@ -941,11 +1062,8 @@ void *main_parse_loop(void *in)
   { cerr << "vw: example #" << example_number << e.what() << endl;
   }
 
-  if (!all->p->done)
-  { mutex_lock(&all->p->examples_lock);
-	all->p->done = true;
-	mutex_unlock(&all->p->examples_lock);
-  }
+  if (!all->p->sync->done.load())
+    set_parser_done(*all->p);
 
   examples.delete_v();
   return 0L;
@@ -954,27 +1072,20 @@ void *main_parse_loop(void *in)
 namespace VW
 {
 example* get_example(parser* p)
-{ mutex_lock(&p->examples_lock);
-  if (p->end_parsed_examples != p->used_index)
-  { size_t ring_index = p->used_index++ % p->ring_size;
-    if (!(p->examples+ring_index)->in_use)
-      cout << "error: example should be in_use " << p->used_index << " " << p->end_parsed_examples << " " << ring_index << endl;
-    assert((p->examples+ring_index)->in_use);
-    mutex_unlock(&p->examples_lock);
-
-    return p->examples + ring_index;
-  }
-  else
-  { if (!p->done)
-    { condition_variable_wait(&p->example_available, &p->examples_lock);
-      mutex_unlock(&p->examples_lock);
-      return get_example(p);
-    }
-    else
-    { mutex_unlock(&p->examples_lock);
-      return nullptr;
-    }
-  }
+{ ring_sync& sync = *p->sync;
+  uint64_t used_index = p->used_index;
+  wait_until(p->ring_spin, p->examples_lock, p->example_available, sync.available_waiters,
+             [&sync, used_index] { return sync.end_parsed_examples.load(std::memory_order_acquire) != used_index || sync.done.load(); });
+
+  // done is only set after the final examples are published, so recheck the index once more
+  if (sync.end_parsed_examples.load(std::memory_order_acquire) == used_index)
+    return nullptr;
+
+  size_t ring_index = p->used_index++ % p->ring_size;
+  if (!(p->examples+ring_index)->in_use)
+    cout << "error: example should be in_use " << p->used_index << " " << p->end_parsed_examples << " " << ring_index << endl;
+  assert((p->examples+ring_index)->in_use);
+  return p->examples + ring_index;
 }
 
 float get_topic_prediction(example* ec, size_t i)
@@ -1026,13 +1137,22 @@ void initialize_examples(vw& all)
 { all.p->used_index = 0;
   all.p->begin_parsed_examples = 0;
   all.p->end_parsed_examples = 0;
-  all.p->done = false;
+
+  ring_sync& sync = *all.p->sync;
+  sync.end_parsed_examples = 0;
+  sync.finished_examples = 0;
+  sync.done = false;
+  sync.unused_waiters = 0;
+  sync.available_waiters = 0;
+  sync.output_waiters = 0;
+  sync.busy = new std::atomic<bool>[all.p->ring_size];
 
   all.p->examples = calloc_or_throw<example>(all.p->ring_size);
 
   for (size_t i = 0; i < all.p->ring_size; i++)
   { memset(&all.p->examples[i].l, 0, sizeof(polylabel));
     all.p->examples[i].in_use = false;
+    sync.busy[i] = false;
   }
 }
 
@@ -1052,7 +1172,8 @@ void initialize_parser_datastructures(vw& all)
 namespace VW
 {
 void start_parser(vw& all)
-{
+{ if (all.p->parse_threads > 1)
+    start_parse_threads(all);
 #ifndef _WIN32
   pthread_create(&all.parse_thread, nullptr, main_parse_loop, &all);
 #else
@@ -1074,6 +1195,9 @@ void free_parser(vw& all)
 
     free(all.p->examples);
   }
+  destroy_example_pool(all.p->spare, all.p->lp.delete_label, all.delete_prediction);
+  delete[] all.p->sync->busy;
+  delete all.p->sync;
 
   io_buf* output = all.p->output;
   if (output != nullptr)
@@ -1082,6 +1206,7 @@ void free_parser(vw& all)
   }
 
   all.p->counts.delete_v();
+  free_block_cache(*all.p);
 }
 
 void release_parser_datastructures(vw& all)
@@ -1099,10 +1224,16 @@ void end_parser(vw& all)
   ::WaitForSingleObject(all.parse_thread, INFINITE);
   ::CloseHandle(all.parse_thread);
 #endif
+  if (all.p->pool != nullptr)
+    end_parse_threads(all);
   release_parser_datastructures(all);
 }
 
 bool is_ring_example(vw& all, example* ae)
 { return all.p->examples <= ae && ae < all.p->examples + all.p->ring_size;
 }
+
+bool is_pooled_example(vw& all, example* ae)
+{ return from_pool(*all.p->spare, ae);
+}
 }
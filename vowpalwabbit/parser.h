@@ -12,6 +12,12 @@ license as described in the file LICENSE.
 namespace po = boost::program_options;
 
 struct vw;
+struct shared_data;
+struct ring_sync; // atomic handoff state for the example ring, private to parser.cc
+struct parse_pool; // worker threads for --parse_threads, private to parse_threads.cc
+struct block_reader; // position in a block structured cache, private to cache.cc
+struct block_writer; // block structured cache being written, private to cache.cc
+struct example_pool; // examples of the library readers, see example_pool.h
 
 struct parser
 { v_array<substring> channels;//helper(s) for text parsing
@@ -28,20 +34,21 @@ struct parser
   bool sorted_cache;
 
   size_t ring_size;
+  size_t ring_spin; // number of polls of the ring before a waiting thread blocks on a condition variable
   uint64_t begin_parsed_examples; // The index of the beginning parsed example.
   uint64_t end_parsed_examples; // The index of the fully parsed example.
-  uint64_t local_example_number;
   uint32_t in_pass_counter;
   example* examples;
+  example_pool* spare; // examples for the library readers, outside the ring
   uint64_t used_index;
   bool emptylines_separate_examples; // true if you want to have holdout computed on a per-block basis rather than a per-line basis
+  ring_sync* sync; // published indices and per-slot ownership; locks below are only taken to block
   MUTEX examples_lock;
   CV example_available;
   CV example_unused;
   MUTEX output_lock;
   CV output_done;
 
-  bool done;
   v_array<size_t> gram_mask;
 
   v_array<size_t> ids; //unique ids for sources
@@ -56,6 +63,19 @@ struct parser
   label_parser lp;  // moved from vw
 
   void* jsonp;
+
+  size_t parse_threads; // number of threads tokenizing text/json input, 1 parses on the parse thread itself
+  size_t parse_chunk_size; // lines handed to a parse thread at a time
+  bool parse_unordered; // deliver chunks to the learner as they complete instead of in input order
+  parse_pool* pool;
+
+  size_t cache_block_size; // write new caches as blocks of about this many bytes, 0 writes the single stream format
+  unsigned char cache_codec; // compression of the blocks of a new block cache, see cache.h
+  block_writer* block_out;
+  bool block_cache; // the cache being read is block structured
+  block_reader* block_in;
+  size_t cache_shard; // read only block range cache_shard of cache_shards
+  size_t cache_shards;
 };
 
 parser* new_parser();
@@ -80,3 +100,12 @@ void finalize_source(parser* source);
 void set_compressed(parser* par);
 void initialize_examples(vw& all);
 void free_parser(vw& all);
+
+//phases of VW::setup_example, run separately when parsing on several threads
+void setup_example_position(vw& all, example* ae); //order dependent: example counter and holdout
+void setup_example_features(vw& all, parser& p, example* ae); //ignore, ngrams, constant, limits and feature counts
+void parse_example_label(parser& p, shared_data* sd, example& ec, std::string label);
+
+//examples are published to the learner from the parse thread only
+void publish_examples(parser& p, uint64_t count);
+bool parser_done(parser& p);
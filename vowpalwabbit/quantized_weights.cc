@@ -0,0 +1,119 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <math.h>
+#include <sstream>
+#include <algorithm>
+#include "vw_exception.h"
+#include "memory.h"
+#include "io_buf.h"
+#include "gd.h"
+#include "quantized_weights.h"
+
+using namespace std;
+
+quantization parse_quantization(const string& name)
+{ if (name == "fp16")
+    return QUANTIZE_FP16;
+  else if (name == "int8")
+    return QUANTIZE_INT8;
+  else
+    THROW("--quantize takes fp16 or int8, not " << name);
+}
+
+const char* quantization_name(quantization kind)
+{ switch (kind)
+  { case QUANTIZE_FP16:
+      return "fp16";
+    case QUANTIZE_INT8:
+      return "int8";
+    default:
+      return "none";
+  }
+}
+
+uint16_t float_to_half(float f)
+{ uint32_t x = float_to_bits(f);
+  uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x > 0x7f800000) // nan
+    return sign | 0x7e00;
+  if (x >= 0x477ff000) // rounds beyond 65504, the largest half
+    return sign | 0x7bff;
+  if (x < 0x38800000) // below 2^-14, the smallest normal half, so a multiple of 2^-24
+    return sign | (uint16_t)lrintf(bits_to_float(x) * 16777216.f);
+  x += 0xfff + ((x >> 13) & 1); // round the 13 dropped bits to nearest even
+  return sign | (uint16_t)((x - (112 << 23)) >> 13);
+}
+
+quantized_weights::quantized_weights(quantization kind, size_t length, uint32_t stride_shift)
+  : _kind(kind), _mask((length << stride_shift) - 1), _stride_shift(stride_shift),
+    _halves(nullptr), _bytes(nullptr), _scales(nullptr)
+{ if (kind == QUANTIZE_FP16)
+    _halves = calloc_or_throw<uint16_t>(length);
+  else
+  { _bytes = calloc_or_throw<int8_t>(length);
+    _scales = calloc_or_throw<float>((length + (1 << quantized_block_shift) - 1) >> quantized_block_shift);
+  }
+}
+
+quantized_weights::~quantized_weights()
+{ free_it(_halves);
+  free_it(_bytes);
+  free_it(_scales);
+}
+
+void quantized_weights::quantize(dense_parameters& weights, float gravity, float contraction)
+{ weight* first = weights.first();
+  uint32_t shift = weights.stride_shift();
+  size_t length = this->length();
+  if (_kind == QUANTIZE_FP16)
+  { for (size_t f = 0; f < length; f++)
+      _halves[f] = float_to_half(GD::trunc_weight(first[f << shift], gravity) * contraction);
+    return;
+  }
+
+  const size_t block = (size_t)1 << quantized_block_shift;
+  float values[block];
+  for (size_t start = 0; start < length; start += block)
+  { size_t n = min(block, length - start);
+    float largest = 0.f;
+    for (size_t j = 0; j < n; j++)
+    { values[j] = GD::trunc_weight(first[(start + j) << shift], gravity) * contraction;
+      largest = max(largest, fabsf(values[j]));
+    }
+    float scale = largest / 127.f;
+    _scales[start >> quantized_block_shift] = scale;
+    for (size_t j = 0; j < n; j++)
+      _bytes[start + j] = scale > 0.f ? (int8_t)lrintf(values[j] / scale) : 0;
+  }
+}
+
+void save_load_bytes(io_buf& model_file, char* data, size_t bytes, bool read)
+{ const size_t chunk = 1 << 16; // io_buf hands out less than its buffer at a time
+  stringstream msg;
+  for (size_t done = 0; done < bytes; done += chunk)
+  { size_t n = min(chunk, bytes - done);
+    if (bin_text_read_write_fixed_validated(model_file, data + done, n, "", read, msg, false) != n)
+      THROW("the quantized weights of the model are truncated");
+  }
+}
+
+void quantized_weights::save_load(io_buf& model_file, bool read)
+{ uint32_t kind = _kind;
+  uint64_t length = this->length();
+  save_load_bytes(model_file, (char*)&kind, sizeof(kind), read);
+  save_load_bytes(model_file, (char*)&length, sizeof(length), read);
+  if (read && (kind != (uint32_t)_kind || length != this->length()))
+    THROW("the model holds " << length << " " << quantization_name((quantization)kind) << " weights rather than "
+          << this->length() << " " << quantization_name(_kind) << " ones");
+  if (_kind == QUANTIZE_FP16)
+    save_load_bytes(model_file, (char*)_halves, length * sizeof(uint16_t), read);
+  else
+  { save_load_bytes(model_file, (char*)_bytes, length, read);
+    save_load_bytes(model_file, (char*)_scales,
+                    ((length + (1 << quantized_block_shift) - 1) >> quantized_block_shift) * sizeof(float), read);
+  }
+}
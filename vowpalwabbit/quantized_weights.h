@@ -0,0 +1,74 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+#include "floatbits.h"
+#include "array_parameters.h"
+
+class io_buf;
+
+// How --quantized_regressor stores the weights of a prediction-only model.
+enum quantization { QUANTIZE_NONE = 0, QUANTIZE_FP16, QUANTIZE_INT8 };
+
+quantization parse_quantization(const std::string& name);
+const char* quantization_name(quantization kind);
+
+// IEEE half precision, rounding to nearest even.  Floats beyond the largest half saturate.
+uint16_t float_to_half(float f);
+
+inline float half_to_float(uint16_t h)
+{ uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) // zero or subnormal, mantissa * 2^-24
+  { float f = mantissa * 5.9604645e-8f;
+    return sign ? -f : f;
+  }
+  if (exponent == 0x1f)
+    return bits_to_float(sign | 0x7f800000 | (mantissa << 13));
+  return bits_to_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+const uint32_t quantized_block_shift = 6; // int8 weights share one scale per 64 features
+
+// The first weight of each stride of a dense table, rounded to fp16 or to int8 with a scale per
+// block of features, so that a model which only predicts takes 2 or about 1 byte per feature
+// rather than 4 << stride_shift.  Indexed like the table it was made from.
+class quantized_weights
+{
+private:
+  quantization _kind;
+  uint64_t _mask;         // of indices into the original table
+  uint32_t _stride_shift; // of the original table
+  uint16_t* _halves;      // fp16
+  int8_t* _bytes;         // int8
+  float* _scales;         // int8, per block
+
+public:
+  quantized_weights(quantization kind, size_t length, uint32_t stride_shift);
+  ~quantized_weights();
+
+  // Rounds the weights, truncated by gravity and scaled by contraction as gd predicts with them.
+  void quantize(dense_parameters& weights, float gravity, float contraction);
+  void save_load(io_buf& model_file, bool read);
+
+  size_t length() { return (_mask + 1) >> _stride_shift; }
+  quantization kind() { return _kind; }
+
+  inline float fp16(uint64_t i) const { return half_to_float(_halves[(i & _mask) >> _stride_shift]); }
+
+  inline float int8(uint64_t i) const
+  { uint64_t f = (i & _mask) >> _stride_shift;
+    return _bytes[f] * _scales[f >> quantized_block_shift];
+  }
+
+  template<quantization kind> inline float get(uint64_t i) const { return kind == QUANTIZE_FP16 ? fp16(i) : int8(i); }
+
+  // gd reads these through callbacks given the feature index, which do not prefetch
+  bool prefetching() const { return false; }
+  void prefetch(uint64_t) const {}
+};
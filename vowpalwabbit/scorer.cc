@@ -1,6 +1,7 @@
 #include <float.h>
 #include "correctedMath.h"
 #include "reductions.h"
+#include "scorer.h"
 #include "vw_exception.h"
 
 using namespace std;
@@ -84,3 +85,14 @@ LEARNER::base_learner* scorer_setup(vw& all)
 
   return all.scorer;
 }
+
+link_function scorer_link(vw& all)
+{ string link = all.vm["link"].as<string>();
+  if (link.compare("logistic") == 0)
+    return logistic;
+  else if (link.compare("glf1") == 0)
+    return glf1;
+  else if (link.compare("poisson") == 0)
+    return expf;
+  return id;
+}
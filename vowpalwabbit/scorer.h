@@ -1 +1,5 @@
 LEARNER::base_learner* scorer_setup(vw& all);
+
+typedef float (*link_function)(float);
+// the link function the scorer applies to predictions, as chosen with --link
+link_function scorer_link(vw& all);
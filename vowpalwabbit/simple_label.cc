@@ -106,13 +106,17 @@ void print_update(vw& all, example& ec)
   }
 }
 
-void output_and_account_example(vw& all, example& ec)
+void account_example(vw& all, example& ec)
 { label_data ld = ec.l.simple;
 
   all.sd->update(ec.test_only, ec.loss, ec.weight, ec.num_features);
   if (ld.label != FLT_MAX && !ec.test_only)
     all.sd->weighted_labels += ld.label * ec.weight;
   all.sd->weighted_unlabeled_examples += ld.label == FLT_MAX ? ec.weight : 0;
+}
+
+void output_and_account_example(vw& all, example& ec)
+{ account_example(all, ec);
 
   all.print(all.raw_prediction, ec.partial_prediction, -1, ec.tag);
   for (size_t i = 0; i<all.final_prediction_sink.size(); i++)
@@ -21,4 +21,5 @@ extern label_parser simple_label;
 
 bool summarize_holdout_set(vw& all, size_t& no_win_counter);
 void print_update(vw& all, example &ec);
+void account_example(vw& all, example& ec); // adds the example to the loss and label statistics
 void output_and_account_example(vw& all, example& ec);
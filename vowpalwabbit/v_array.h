@@ -81,6 +81,11 @@ public:
       item->~T();
     _end = _begin;
   }
+  void clear() // like erase, but keeps the buffer however large it grew
+  { for (T*item = _begin; item != _end; ++item)
+      item->~T();
+    _end = _begin;
+  }
   void delete_v()
   { if (_begin != nullptr)
     { for (T*item = _begin; item != _end; ++item)
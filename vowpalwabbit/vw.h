@@ -44,6 +44,7 @@ void sync_stats(vw& all);
 void start_parser(vw& all);
 void end_parser(vw& all);
 bool is_ring_example(vw& all, example* ae);
+bool is_pooled_example(vw& all, example* ae); // from read_example, import_example or new_unused_example
 
 struct primitive_feature_space   //just a helper definition.
 { unsigned char name;
@@ -51,7 +52,8 @@ struct primitive_feature_space   //just a helper definition.
   size_t len;
 };
 
-//The next commands deal with creating examples.  Caution: VW does not all allow creation of many examples at once by default.  You can adjust the exact number by tweaking ring_size.
+//The next commands deal with creating examples.  They come from a pool which grows as needed, so any number may be
+//in flight at once, and finish_example hands them back to be reused along with the memory their features took.
 
 /* The simplest of two ways to create an example.  An example_line is the literal line in a VW-format datafile.
  */
@@ -0,0 +1,245 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sstream>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "vw_exception.h"
+#include "memory.h"
+#include "weight_memory.h"
+
+using namespace std;
+
+void parse_hugepages(weight_memory& memory, string arg)
+{ if (arg == "none")
+    memory.pages = weight_memory::DEFAULT_PAGES;
+  else if (arg == "transparent")
+    memory.pages = weight_memory::TRANSPARENT_PAGES;
+  else if (arg == "2m" || arg == "2M")
+    memory.pages = weight_memory::HUGE_2M;
+  else if (arg == "1g" || arg == "1G")
+    memory.pages = weight_memory::HUGE_1G;
+  else
+    THROW("--hugepages takes none, transparent, 2m or 1g, not " << arg);
+}
+
+void parse_numa(weight_memory& memory, string arg)
+{ if (arg == "interleave")
+  { memory.numa = weight_memory::NUMA_INTERLEAVE;
+    return;
+  }
+  char* end;
+  long node = strtol(arg.c_str(), &end, 10);
+  if (arg.empty() || *end != '\0' || node < 0 || node >= 64)
+    THROW("--numa takes interleave or the number of a node below 64 to bind to, not " << arg);
+  memory.numa = weight_memory::NUMA_BIND;
+  memory.numa_node = (int)node;
+}
+
+#ifdef __linux__
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+const int mpol_bind = 2; // from linux/mempolicy.h, so that libnuma is not needed
+const int mpol_interleave = 3;
+
+inline size_t round_up(size_t n, size_t unit) { return (n + unit - 1) / unit * unit; }
+
+void* map_huge(size_t bytes, int log_page, size_t& mapped)
+{ mapped = round_up(bytes, (size_t)1 << log_page);
+  void* data = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log_page << MAP_HUGE_SHIFT), -1, 0);
+  return data == MAP_FAILED ? nullptr : data;
+}
+
+// Anonymous memory aligned to 2MB, so that transparent huge pages can back all of it.
+void* map_aligned(size_t bytes, size_t& mapped)
+{ const size_t align = (size_t)1 << 21;
+  mapped = round_up(bytes, align);
+  char* data = (char*)mmap(nullptr, mapped + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if ((void*)data == MAP_FAILED)
+    return nullptr;
+  char* start = (char*)round_up((size_t)data, align);
+  if (start > data)
+    munmap(data, start - data);
+  munmap(start + mapped, data + align - start);
+  return start;
+}
+
+// Sets the policy before anything is touched, so every page is placed as it is first faulted.
+bool bind_numa(void* data, size_t mapped, weight_memory& memory)
+{ unsigned long nodes = memory.numa == weight_memory::NUMA_INTERLEAVE ? ~0UL : 1UL << memory.numa_node;
+  int mode = memory.numa == weight_memory::NUMA_INTERLEAVE ? mpol_interleave : mpol_bind;
+  // the kernel reads one bit less than maxnode
+  return syscall(SYS_mbind, data, mapped, mode, &nodes, sizeof(nodes) * 8 + 1, 0) == 0;
+}
+#endif
+
+void* alloc_weights(size_t bytes, weight_memory& memory, size_t& mapped)
+{ mapped = 0;
+#ifdef __linux__
+  if (memory.reserve_only)
+  { void* data = map_aligned(bytes, mapped);
+    if (data == nullptr)
+      THROWERRNO("failed to map " << bytes << " bytes of weights");
+    memory.backing = "reserved zero pages";
+    return data;
+  }
+#endif
+  if (!memory.requested())
+  { memory.backing = "default pages";
+    return calloc_mergable_or_throw<char>(bytes);
+  }
+#ifdef __linux__
+  stringstream backing;
+  backing << (bytes >> 20) << " MB on ";
+  void* data = nullptr;
+  weight_memory::page_kind pages = memory.pages;
+  if (pages == weight_memory::HUGE_2M || pages == weight_memory::HUGE_1G)
+  { const char* name = pages == weight_memory::HUGE_1G ? "1G" : "2M";
+    data = map_huge(bytes, pages == weight_memory::HUGE_1G ? 30 : 21, mapped);
+    if (data != nullptr)
+      backing << name << " huge pages";
+    else
+    { backing << name << " huge pages unavailable (" << strerror(errno) << "), using ";
+      pages = weight_memory::TRANSPARENT_PAGES;
+    }
+  }
+  if (data == nullptr)
+  { data = map_aligned(bytes, mapped);
+    if (data == nullptr)
+      THROWERRNO("failed to map " << bytes << " bytes of weights");
+    if (pages != weight_memory::TRANSPARENT_PAGES)
+      backing << "default pages";
+    else if (madvise(data, mapped, MADV_HUGEPAGE) == 0)
+      backing << "transparent huge pages";
+    else
+      backing << "default pages, transparent huge pages are unavailable (" << strerror(errno) << ")";
+  }
+
+  if (memory.numa != weight_memory::NUMA_DEFAULT)
+  { if (!bind_numa(data, mapped, memory))
+      backing << ", NUMA policy not applied (" << strerror(errno) << ")";
+    else if (memory.numa == weight_memory::NUMA_INTERLEAVE)
+      backing << ", interleaved across NUMA nodes";
+    else
+      backing << ", bound to NUMA node " << memory.numa_node;
+  }
+  memory.backing = backing.str();
+  return data;
+#else
+  memory.backing = "default pages, --hugepages and --numa need Linux";
+  return calloc_mergable_or_throw<char>(bytes);
+#endif
+}
+
+void free_weights(void* data, size_t mapped)
+{
+#ifndef _WIN32
+  if (mapped > 0)
+  { munmap(data, mapped);
+    return;
+  }
+#endif
+  free(data);
+}
+
+const char mapped_magic[8] = { 'V', 'W', 'M', 'A', 'P', 'P', 'E', 'D' };
+
+#ifndef _WIN32
+bool read_mapped_trailer(const string& file, mapped_trailer& trailer)
+{ int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  bool valid = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size >= sizeof(trailer)
+               && pread(fd, &trailer, sizeof(trailer), st.st_size - sizeof(trailer)) == (ssize_t)sizeof(trailer);
+  close(fd);
+  return valid && memcmp(trailer.magic, mapped_magic, sizeof(mapped_magic)) == 0
+         && trailer.offset % mapped_alignment == 0 && trailer.stride_shift < 32
+         && trailer.offset + (trailer.length << trailer.stride_shift) * sizeof(float) + sizeof(trailer)
+            == (uint64_t)st.st_size;
+}
+
+void* map_model_weights(const string& file, const mapped_trailer& trailer, bool writable, size_t& mapped)
+{ int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    THROWERRNO("can not open the mapped model " << file);
+  mapped = (trailer.length << trailer.stride_shift) * sizeof(float);
+  void* data = mmap(nullptr, mapped, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                    writable ? MAP_PRIVATE : MAP_SHARED, fd, trailer.offset);
+  close(fd);
+  if (data == MAP_FAILED)
+    THROWERRNO("failed to map the weights of " << file);
+  return data;
+}
+
+void write_all(int fd, const char* data, size_t bytes)
+{ while (bytes > 0)
+  { ssize_t put = write(fd, data, bytes);
+    if (put < 0)
+    { if (errno == EINTR)
+        continue;
+      THROWERRNO("failed to write a mapped model");
+    }
+    data += put;
+    bytes -= put;
+  }
+}
+
+void write_mapped_weights(int fd, const float* table, size_t length, uint32_t stride_shift, uint32_t kept_shift)
+{ off_t end = lseek(fd, 0, SEEK_END);
+  if (end < 0)
+    THROWERRNO("lseek");
+  mapped_trailer trailer;
+  memcpy(trailer.magic, mapped_magic, sizeof(mapped_magic));
+  trailer.offset = (end + mapped_alignment - 1) / mapped_alignment * mapped_alignment;
+  trailer.length = length;
+  trailer.stride_shift = kept_shift;
+  trailer.unused = 0;
+  char zeros[4096];
+  memset(zeros, 0, sizeof(zeros));
+  for (size_t pad = trailer.offset - end; pad > 0; pad -= min(pad, sizeof(zeros)))
+    write_all(fd, zeros, min(pad, sizeof(zeros)));
+  if (kept_shift == stride_shift)
+    write_all(fd, (const char*)table, (length << stride_shift) * sizeof(float));
+  else
+  { float chunk[4096]; // a multiple of any kept stride
+    size_t kept = (size_t)1 << kept_shift;
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++)
+    { memcpy(chunk + n, table + (i << stride_shift), kept * sizeof(float));
+      n += kept;
+      if (n == 4096 || i + 1 == length)
+      { write_all(fd, (const char*)chunk, n * sizeof(float));
+        n = 0;
+      }
+    }
+  }
+  write_all(fd, (const char*)&trailer, sizeof(trailer));
+}
+#else
+bool read_mapped_trailer(const string&, mapped_trailer&)
+{ return false;
+}
+
+void* map_model_weights(const string& file, const mapped_trailer&, bool, size_t&)
+{ THROW("mapping the model " << file << " is not supported on Windows");
+}
+
+void write_mapped_weights(int, const float*, size_t, uint32_t, uint32_t)
+{ THROW("--mapped_regressor is not supported on Windows");
+}
+#endif
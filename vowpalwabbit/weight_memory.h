@@ -0,0 +1,61 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// How the dense weight table is backed, see --hugepages and --numa.  Hashed features touch
+// the table at random, so with large -b most lookups miss the TLB unless pages are large.
+struct weight_memory
+{ enum page_kind { DEFAULT_PAGES, TRANSPARENT_PAGES, HUGE_2M, HUGE_1G };
+  enum numa_policy { NUMA_DEFAULT, NUMA_INTERLEAVE, NUMA_BIND };
+
+  page_kind pages;
+  numa_policy numa;
+  int numa_node;       // for NUMA_BIND
+  std::string backing; // what the last allocation obtained, for the startup report
+  std::string map_file; // a --mapped_regressor model the table is mapped from, see below
+  bool map_read_only;   // the mapping is shared with the page cache rather than copy-on-write
+  bool reserve_only;    // nothing fills the table, e.g. under a quantized model, so its pages
+                        // are left to read as zeros without taking memory
+
+  weight_memory() : pages(DEFAULT_PAGES), numa(NUMA_DEFAULT), numa_node(0), map_read_only(false), reserve_only(false) {}
+
+  bool requested() const { return pages != DEFAULT_PAGES || numa != NUMA_DEFAULT; }
+};
+
+void parse_hugepages(weight_memory& memory, std::string arg);
+void parse_numa(weight_memory& memory, std::string arg);
+
+// Returns zeroed, page aligned memory for bytes of weights.  mapped is set to the length that
+// must be passed to free_weights, 0 for memory from the heap.  Falls back on smaller pages
+// when the requested ones can not be had, and records what was obtained in memory.backing.
+void* alloc_weights(size_t bytes, weight_memory& memory, size_t& mapped);
+void free_weights(void* data, size_t mapped);
+
+// A --mapped_regressor model is an ordinary model file in which gd leaves out the weights,
+// followed by the whole dense weight table at a multiple of mapped_alignment and this trailer.
+// -i maps the table rather than reading the weights one by one, so loading the model only
+// reads the header, and processes mapping it read-only share one copy in the page cache.
+struct mapped_trailer
+{ char magic[8];          // "VWMAPPED"
+  uint64_t offset;        // of the table in the file
+  uint64_t length;        // 1 << bits
+  uint32_t stride_shift;  // of the table, which holds length << stride_shift weights
+  uint32_t unused;
+};
+const size_t mapped_alignment = 1 << 16; // a multiple of the page size on every platform
+
+// Reads the trailer of file, false if it is not a valid mapped model.
+bool read_mapped_trailer(const std::string& file, mapped_trailer& trailer);
+// Maps the table of file, which has trailer.  A writable mapping is private and copy-on-write.
+// mapped is set as for alloc_weights.
+void* map_model_weights(const std::string& file, const mapped_trailer& trailer, bool writable, size_t& mapped);
+// Pads the file open for writing on fd to mapped_alignment and appends the table, which holds
+// length << stride_shift weights, and the trailer.  Of each stride only the first
+// 1 << kept_shift weights are written, so the file's table has stride_shift kept_shift.
+void write_mapped_weights(int fd, const float* table, size_t length, uint32_t stride_shift, uint32_t kept_shift);